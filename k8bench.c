@@ -0,0 +1,450 @@
+//Kernel8 multiplexer benchmark suite.
+//Times every multiplexer family over a range of state sizes and parallelism aliases,
+//and prints the results as CSV on stdout so that builds can be compared against each other.
+//Usage: k8bench.out [max state] [minimum seconds per measurement]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "kerneln.h"
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(__clang__)
+#define B_COMPILER "clang-" __clang_version__
+#elif defined(__GNUC__)
+#define B_COMPILER "gcc-" __VERSION__
+#else
+#define B_COMPILER "unknown"
+#endif
+
+static double b_now(){
+#if defined(_OPENMP)
+	return omp_get_wtime();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+//On the pool backend it's the pool which gets resized, OpenMP isn't running the multiplexers.
+static int b_max_threads(){
+#if defined(K8_BACKEND_POOL)
+	return k8_pool_size();
+#elif defined(_OPENMP)
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+static void b_set_threads(int t){
+#if defined(K8_BACKEND_POOL)
+	k8_pool_set_threads(t);
+#endif
+#if defined(_OPENMP)
+	omp_set_num_threads(t);
+#else
+	(void)t;
+#endif
+}
+
+/*
+Kernels being multiplexed.
+They are cheap on purpose, so that the multiplexer itself dominates the measurement.
+*/
+static inline void b_k_mix3(state3 *c){
+	uint32_t x = from_state3(*c);
+	x = (x * 2654435761u) ^ (x >> 13);
+	*c = to_state3(x);
+}
+static inline void b_k_fillind(state4 *c){
+	k_pat(c,1,3,4) = k_pat(c,0,3,4);
+}
+static inline void b_k_sum32(state4 *c){
+	c->state3s[0] = to_state3(from_state3(c->state3s[0]) + from_state3(c->state3s[1]));
+}
+static inline void b_k_dupe(state4 *c){
+	c->state3s[1] = c->state3s[0];
+}
+static inline void b_k_pair(state4 *c){
+	c->state3s[1] = to_state3(from_state3(c->state3s[1]) ^ from_state3(c->state3s[0]));
+}
+//The same kernels, taking pointers to the two elements.
+static inline void b_k_sum32p(state3 *x, state3 *y){
+	*x = to_state3(from_state3(*x) + from_state3(*y));
+}
+static inline void b_k_dupep(state3 *x, state3 *y){
+	*y = *x;
+}
+static inline void b_k_pairp(state3 *x, state3 *y){
+	*y = to_state3(from_state3(*y) ^ from_state3(*x));
+}
+//Big elements, where the copies into a state11 and back cost the most.
+static inline void b_k_dupe11(state11 *c){
+	c->state10s[1] = c->state10s[0];
+}
+static inline void b_k_dupe10p(state10 *x, state10 *y){
+	*y = *x;
+}
+static inline void b_k_rev32(state3 *c){
+	*c = to_state3(~from_state3(*c));
+}
+static inline void b_k_rev16(state2 *c){
+	*c = to_state2(~from_state2(*c));
+}
+static inline void b_k_rev8(state1 *c){
+	*c = to_state1(~from_state1(*c));
+}
+static inline void b_k_and127(state1 *c){c->state[0] &= 127;}
+static inline void b_k_and63(state1 *c){c->state[0] &= 63;}
+static kernelpb1 b_and7667_funcs[4] = {b_k_and127, b_k_and63, b_k_and63, b_k_and127};
+K8_MULTIPLEX_MULTIK8_NP(b_and7667, b_and7667_funcs, 1, 3, 0)
+#define B_AND7667(X) X(b_k_and127) X(b_k_and63) X(b_k_and63) X(b_k_and127)
+K8_CHAINP(b_k_rev8and127, b_k_rev8, b_k_and127, 1)
+K8_TABULATE1(b_t_rev8and127, b_k_rev8and127, 0)
+
+#define B_ELEMS(nn, nm) ((size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+//Every benchmark gets a thunk so that they can be stored in one table.
+#define B_THUNK(name, nm) static void name##_run(void* p){name((state##nm*)p);}
+
+/*
+Definitions for each family.
+B_DEF_<family>(alias, nm) generates the kernel,
+B_ROW_<family>(alias, nm) generates the table entry
+{family, alias, state, element state, kernel invocations per call, bytes touched per call, thunk, parallel?}
+*/
+#define B_DEF_MULTIPLEX(alias, nm)\
+K8_MULTIPLEX_PARTIAL_ALIAS(b_multiplex_##alias##_##nm, b_k_mix3, 3, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_multiplex_##alias##_##nm, nm)
+#define B_ROW_MULTIPLEX(alias, nm)\
+{"K8_MULTIPLEX", #alias, nm, 3, B_ELEMS(3, nm), 2.0*STATE_SIZE(nm), b_multiplex_##alias##_##nm##_run},
+
+//The same, with K8_MULTIPLEX_AUTO choosing how to run it. It calibrates in its first calls,
+//which doesn't matter since the fastest call is the one reported.
+#define B_DEF_MULTIPLEX_AUTO(alias, nm)\
+K8_MULTIPLEX_AUTO(b_multiplex_##alias##_##nm, b_k_mix3, 3, nm, 0)\
+B_THUNK(b_multiplex_##alias##_##nm, nm)
+#define B_ROW_MULTIPLEX_AUTO(alias, nm)\
+{"K8_MULTIPLEX_AUTO", #alias, nm, 3, B_ELEMS(3, nm), 2.0*STATE_SIZE(nm), b_multiplex_##alias##_##nm##_run},
+
+#define B_DEF_INDEXED(alias, nm)\
+K8_MULTIPLEX_INDEXED_PARTIAL_ALIAS(b_indexed_##alias##_##nm, b_k_fillind, 3, 4, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_indexed_##alias##_##nm, nm)
+#define B_ROW_INDEXED(alias, nm)\
+{"K8_MULTIPLEX_INDEXED", #alias, nm, 3, B_ELEMS(3, nm), 2.0*STATE_SIZE(nm), b_indexed_##alias##_##nm##_run},
+
+#define B_DEF_SHUFFLE_IND32(alias, nm)\
+K8_SHUFFLE_IND32(b_shuffle32_##alias##_##nm, b_k_rev32, 3, nm, 0)\
+B_THUNK(b_shuffle32_##alias##_##nm, nm)
+#define B_ROW_SHUFFLE_IND32(alias, nm)\
+{"K8_SHUFFLE_IND32", #alias, nm, 3, B_ELEMS(3, nm), 3.0*STATE_SIZE(nm), b_shuffle32_##alias##_##nm##_run},
+
+#define B_DEF_SHUFFLE_IND32_ALIAS(alias, nm)\
+K8_SHUFFLE_IND32_PARTIAL_ALIAS(b_shuffle32a_##alias##_##nm, b_k_rev32, 3, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_shuffle32a_##alias##_##nm, nm)
+#define B_ROW_SHUFFLE_IND32_ALIAS(alias, nm)\
+{"K8_SHUFFLE_IND32_PARTIAL_ALIAS", #alias, nm, 3, B_ELEMS(3, nm), 3.0*STATE_SIZE(nm), b_shuffle32a_##alias##_##nm##_run},
+
+#define B_DEF_SHUFFLE_IND16(alias, nm)\
+K8_SHUFFLE_IND16(b_shuffle16_##alias##_##nm, b_k_rev16, 3, nm, 0)\
+B_THUNK(b_shuffle16_##alias##_##nm, nm)
+#define B_ROW_SHUFFLE_IND16(alias, nm)\
+{"K8_SHUFFLE_IND16", #alias, nm, 3, B_ELEMS(3, nm), 3.0*STATE_SIZE(nm), b_shuffle16_##alias##_##nm##_run},
+
+#define B_DEF_SHUFFLE_IND8(alias, nm)\
+K8_SHUFFLE_IND8(b_shuffle8_##alias##_##nm, b_k_rev8, 3, nm, 0)\
+B_THUNK(b_shuffle8_##alias##_##nm, nm)
+#define B_ROW_SHUFFLE_IND8(alias, nm)\
+{"K8_SHUFFLE_IND8", #alias, nm, 3, B_ELEMS(3, nm), 3.0*STATE_SIZE(nm), b_shuffle8_##alias##_##nm##_run},
+
+#define B_DEF_INDEXED_EMPLACE(alias, nm)\
+K8_MULTIPLEX_INDEXED_EMPLACE(b_emplace_##alias##_##nm, b_k_fillind, 3, 4, nm, 0)\
+B_THUNK(b_emplace_##alias##_##nm, nm)
+#define B_ROW_INDEXED_EMPLACE(alias, nm)\
+{"K8_MULTIPLEX_INDEXED_EMPLACE", #alias, nm, 3, B_ELEMS(3, nm), 4.0*STATE_SIZE(nm), b_emplace_##alias##_##nm##_run},
+#define B_DEF_INDEXED_EMPLACE_ALIAS(alias, nm)\
+K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_ALIAS(b_emplacea_##alias##_##nm, b_k_fillind, 3, 4, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_emplacea_##alias##_##nm, nm)
+#define B_ROW_INDEXED_EMPLACE_ALIAS(alias, nm)\
+{"K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_ALIAS", #alias, nm, 3, B_ELEMS(3, nm), 4.0*STATE_SIZE(nm), b_emplacea_##alias##_##nm##_run},
+
+#define B_DEF_SHARED_STATE(alias, nm)\
+K8_SHARED_STATE(b_shared_##alias##_##nm, b_k_sum32, 3, 4, nm, 0)\
+B_THUNK(b_shared_##alias##_##nm, nm)
+#define B_ROW_SHARED_STATE(alias, nm)\
+{"K8_SHARED_STATE", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_shared_##alias##_##nm##_run},
+#define B_DEF_SHARED_STATE_PAIR(alias, nm)\
+K8_SHARED_STATE_PAIR(b_sharedp_##alias##_##nm, b_k_sum32p, 3, nm)\
+B_THUNK(b_sharedp_##alias##_##nm, nm)
+#define B_ROW_SHARED_STATE_PAIR(alias, nm)\
+{"K8_SHARED_STATE_PAIR", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_sharedp_##alias##_##nm##_run},
+
+#define B_DEF_SHARED_STATE_WIND(alias, nm)\
+K8_SHARED_STATE_WIND(b_sharedwind_##alias##_##nm, b_k_sum32, 3, 4, nm, 2, 1, 1, 0)\
+B_THUNK(b_sharedwind_##alias##_##nm, nm)
+#define B_ROW_SHARED_STATE_WIND(alias, nm)\
+{"K8_SHARED_STATE_WIND", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_sharedwind_##alias##_##nm##_run},
+
+#define B_DEF_REDUCE(alias, nm)\
+K8_REDUCE_PARTIAL_ALIAS(b_reduce_##alias##_##nm, b_k_sum32, 3, 4, nm, 1, B_ELEMS(3, nm), 0, 0, 1, alias)\
+B_THUNK(b_reduce_##alias##_##nm, nm)
+#define B_ROW_REDUCE(alias, nm)\
+{"K8_REDUCE", #alias, nm, 3, B_ELEMS(3, nm)-1, 1.0*STATE_SIZE(nm), b_reduce_##alias##_##nm##_run},
+
+#define B_DEF_SCAN(alias, nm)\
+K8_SCAN_PARTIAL_ALIAS(b_scan_##alias##_##nm, b_k_sum32, 3, 4, nm, 1, B_ELEMS(3, nm), 0, 0, 0, alias)\
+B_THUNK(b_scan_##alias##_##nm, nm)
+#define B_ROW_SCAN(alias, nm)\
+{"K8_SCAN_INCLUSIVE", #alias, nm, 3, B_ELEMS(3, nm)-1, 3.0*STATE_SIZE(nm), b_scan_##alias##_##nm##_run},
+
+static inline void b_k_sum32_merge(state5 *c){
+	c->state3s[0] = to_state3(from_state3(c->state3s[0]) + from_state3(c->state3s[1]) - from_state3(c->state3s[2]));
+}
+#define B_DEF_SHARED_STATE_PRIVATE(alias, nm)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_ALIAS_WIND(b_sharedprv_##alias##_##nm, b_k_sum32, b_k_sum32_merge, 3, 4, 5, nm, 1, B_ELEMS(3, nm), 0, 1, 0, 0, 0, alias)\
+B_THUNK(b_sharedprv_##alias##_##nm, nm)
+#define B_ROW_SHARED_STATE_PRIVATE(alias, nm)\
+{"K8_SHARED_STATE_PRIVATE", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_sharedprv_##alias##_##nm##_run},
+
+//MULTIPLEX's kernel, then a second one, in one pass.
+#define B_DEF_FUSED(alias, nm)\
+K8_FUSED_STAGE(b_fmix_##alias##_##nm, b_k_mix3, 3, nm, 0)\
+K8_FUSED_STAGE(b_frev_##alias##_##nm, b_k_rev32, 3, nm, 0)\
+K8_MULTIPLEX_FUSED_ALIAS(b_fused_##alias##_##nm, nm, 3, alias, b_fmix_##alias##_##nm, b_frev_##alias##_##nm)\
+B_THUNK(b_fused_##alias##_##nm, nm)
+#define B_ROW_FUSED(alias, nm)\
+{"K8_MULTIPLEX_FUSED", #alias, nm, 3, B_ELEMS(3, nm), 2.0*STATE_SIZE(nm), b_fused_##alias##_##nm##_run},
+
+//Four quarters, each through MULTIPLEX's kernel and then a second one, as a task graph.
+//The quarters don't overlap, so only the two nodes of each quarter wait for each other.
+#define B_QUARTER_10 8
+#define B_QUARTER_15 13
+#define B_QUARTER_20 18
+#define B_QUARTER_25 23
+#define B_QUARTER_30 28
+#define B_GRAPH_MPX(name, func, nq)\
+K8_MULTIPLEX_PARTIAL_ALIAS(name, func, 3, nq, 0, B_ELEMS(3, nq), 0, NOPARALLEL)\
+K8_GRAPH_TASK(name, nq)
+#define B_DEF_GRAPH(alias, nm)\
+B_GRAPH_MPX(b_gmix_##alias##_##nm, b_k_mix3, B_QUARTER_##nm)\
+B_GRAPH_MPX(b_grev_##alias##_##nm, b_k_rev32, B_QUARTER_##nm)\
+static void b_graph_##alias##_##nm##_run(void* p){\
+	k8_graph g;\
+	k8_graph_init(&g);\
+	for(int q = 0; q < 4; q++){\
+		char* at = (char*)p + q * (STATE_SIZE(nm) / 4);\
+		k8_graph_add_inplace(&g, b_gmix_##alias##_##nm##_task, at, STATE_SIZE(nm) / 4);\
+		k8_graph_add_inplace(&g, b_grev_##alias##_##nm##_task, at, STATE_SIZE(nm) / 4);\
+	}\
+	k8_graph_run(&g, K8_ALIAS_THREADED(alias));\
+	k8_graph_free(&g);\
+}
+#define B_ROW_GRAPH(alias, nm)\
+{"K8_GRAPH", #alias, nm, 3, B_ELEMS(3, nm), 2.0*STATE_SIZE(nm), b_graph_##alias##_##nm##_run},
+
+#define B_DEF_RO_SHARED_STATE(alias, nm)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS(b_roshared_##alias##_##nm, b_k_dupe, 3, 4, nm, 1, B_ELEMS(3, nm), 0, 0, alias)\
+B_THUNK(b_roshared_##alias##_##nm, nm)
+#define B_ROW_RO_SHARED_STATE(alias, nm)\
+{"K8_RO_SHARED_STATE", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_roshared_##alias##_##nm##_run},
+#define B_DEF_RO_SHARED_STATE_PAIR(alias, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(b_rosharedp_##alias##_##nm, b_k_dupep, 3, nm, 1, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_rosharedp_##alias##_##nm, nm)
+#define B_ROW_RO_SHARED_STATE_PAIR(alias, nm)\
+{"K8_RO_SHARED_STATE_PAIR", #alias, nm, 3, B_ELEMS(3, nm)-1, 2.0*STATE_SIZE(nm), b_rosharedp_##alias##_##nm##_run},
+#define B_DEF_RO_SHARED_STATE10(alias, nm)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS(b_roshared10_##alias##_##nm, b_k_dupe11, 10, 11, nm, 1, B_ELEMS(10, nm), 0, 0, alias)\
+B_THUNK(b_roshared10_##alias##_##nm, nm)
+#define B_ROW_RO_SHARED_STATE10(alias, nm)\
+{"K8_RO_SHARED_STATE", #alias, nm, 10, B_ELEMS(10, nm)-1, 2.0*STATE_SIZE(nm), b_roshared10_##alias##_##nm##_run},
+#define B_DEF_RO_SHARED_STATE10_PAIR(alias, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(b_rosharedp10_##alias##_##nm, b_k_dupe10p, 10, nm, 1, B_ELEMS(10, nm), 0, alias)\
+B_THUNK(b_rosharedp10_##alias##_##nm, nm)
+#define B_ROW_RO_SHARED_STATE10_PAIR(alias, nm)\
+{"K8_RO_SHARED_STATE_PAIR", #alias, nm, 10, B_ELEMS(10, nm)-1, 2.0*STATE_SIZE(nm), b_rosharedp10_##alias##_##nm##_run},
+
+#define B_DEF_HALVES(alias, nm)\
+K8_MULTIPLEX_HALVES_PARTIAL_ALIAS(b_halves_##alias##_##nm, b_k_pair, 3, 4, nm, 0, B_ELEMS(3, nm)/2, 0, alias)\
+B_THUNK(b_halves_##alias##_##nm, nm)
+#define B_ROW_HALVES(alias, nm)\
+{"K8_MULTIPLEX_HALVES", #alias, nm, 3, B_ELEMS(3, nm)/2, 2.0*STATE_SIZE(nm), b_halves_##alias##_##nm##_run},
+#define B_DEF_HALVES_PAIR(alias, nm)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(b_halvesp_##alias##_##nm, b_k_pairp, 3, nm, 0, B_ELEMS(3, nm)/2, alias)\
+B_THUNK(b_halvesp_##alias##_##nm, nm)
+#define B_ROW_HALVES_PAIR(alias, nm)\
+{"K8_MULTIPLEX_HALVES_PAIR", #alias, nm, 3, B_ELEMS(3, nm)/2, 2.0*STATE_SIZE(nm), b_halvesp_##alias##_##nm##_run},
+
+//MULTIK8 indexes its kernel array with the element index, so it is benchmarked multiplexed.
+#define B_DEF_MULTIK8(alias, nm)\
+K8_MULTIPLEX_PARTIAL_ALIAS(b_multik8_##alias##_##nm, b_and7667, 3, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_multik8_##alias##_##nm, nm)
+#define B_ROW_MULTIK8(alias, nm)\
+{"K8_MULTIPLEX_MULTIK8", #alias, nm, 1, B_ELEMS(1, nm), 2.0*STATE_SIZE(nm), b_multik8_##alias##_##nm##_run},
+//The same kernels as an X-macro list, over the whole state.
+#define B_DEF_MULTIK8_LIST(alias, nm)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(b_multik8l_##alias##_##nm, B_AND7667, 1, nm, 0, B_ELEMS(1, nm), 0, alias)\
+B_THUNK(b_multik8l_##alias##_##nm, nm)
+#define B_ROW_MULTIK8_LIST(alias, nm)\
+{"K8_MULTIPLEX_MULTIK8_LIST", #alias, nm, 1, B_ELEMS(1, nm), 2.0*STATE_SIZE(nm), b_multik8l_##alias##_##nm##_run},
+
+//The same byte kernel, as a chain of calls and as a table.
+#define B_DEF_CHAIN1(alias, nm)\
+K8_MULTIPLEX_PARTIAL_ALIAS(b_chain1_##alias##_##nm, b_k_rev8and127, 1, nm, 0, B_ELEMS(1, nm), 0, alias)\
+B_THUNK(b_chain1_##alias##_##nm, nm)
+#define B_ROW_CHAIN1(alias, nm)\
+{"K8_MULTIPLEX(K8_CHAINP)", #alias, nm, 1, B_ELEMS(1, nm), 2.0*STATE_SIZE(nm), b_chain1_##alias##_##nm##_run},
+#define B_DEF_TABLE1(alias, nm)\
+K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(b_table1_##alias##_##nm, b_t_rev8and127_table, nm, 0, B_ELEMS(1, nm), alias)\
+B_THUNK(b_table1_##alias##_##nm, nm)
+#define B_ROW_TABLE1(alias, nm)\
+{"K8_MULTIPLEX_TABLE1", #alias, nm, 1, B_ELEMS(1, nm), 2.0*STATE_SIZE(nm), b_table1_##alias##_##nm##_run},
+
+#define B_DEF_NLOGN(alias, nm)\
+K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(b_nlogn_##alias##_##nm, b_k_pair, 3, 4, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_nlogn_##alias##_##nm, nm)
+#define B_ROW_NLOGN(alias, nm)\
+{"K8_MULTIPLEX_NLOGN", #alias, nm, 3, B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0,\
+	B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0 * 2.0*STATE_SIZE(3), b_nlogn_##alias##_##nm##_run},
+#define B_DEF_NLOGN_PAIR(alias, nm)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(b_nlognp_##alias##_##nm, b_k_pairp, 3, nm, 0, B_ELEMS(3, nm), alias)\
+B_THUNK(b_nlognp_##alias##_##nm, nm)
+#define B_ROW_NLOGN_PAIR(alias, nm)\
+{"K8_MULTIPLEX_NLOGN_PAIR", #alias, nm, 3, B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0,\
+	B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0 * 2.0*STATE_SIZE(3), b_nlognp_##alias##_##nm##_run},
+
+#define B_DEF_NLOGNRO(alias, nm)\
+K8_MULTIPLEX_NLOGNRO_PARTIAL_ALIAS(b_nlognro_##alias##_##nm, b_k_pair, 3, 4, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_nlognro_##alias##_##nm, nm)
+#define B_ROW_NLOGNRO(alias, nm)\
+{"K8_MULTIPLEX_NLOGNRO", #alias, nm, 3, B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0,\
+	B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0 * 2.0*STATE_SIZE(3), b_nlognro_##alias##_##nm##_run},
+
+#define B_DEF_NLOGNRO_BLOCKED(alias, nm)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_ALIAS(b_nlognrob_##alias##_##nm, b_k_pair, 3, 4, nm, 0, B_ELEMS(3, nm), 0, alias)\
+B_THUNK(b_nlognrob_##alias##_##nm, nm)
+#define B_ROW_NLOGNRO_BLOCKED(alias, nm)\
+{"K8_MULTIPLEX_NLOGNRO_BLOCKED", #alias, nm, 3, B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0,\
+	B_ELEMS(3, nm)*(B_ELEMS(3, nm)-1)/2.0 * 2.0*STATE_SIZE(3), b_nlognrob_##alias##_##nm##_run},
+
+#define B_DEF_DATA_EXTRACTION(alias, nm)\
+K8_MULTIPLEX_DATA_EXTRACTION_PARTIAL_ALIAS(b_extract_##alias##_##nm, b_k_mix3, 3, 3, nm, 0, STATE_SIZE(nm)-3+1, 0, alias)\
+B_THUNK(b_extract_##alias##_##nm, nm)
+#define B_ROW_DATA_EXTRACTION(alias, nm)\
+{"K8_MULTIPLEX_DATA_EXTRACTION", #alias, nm, 3, (STATE_SIZE(nm)-3+1+2)/3, 2.0*STATE_SIZE(nm), b_extract_##alias##_##nm##_run},
+
+//Benchmarks with parallelism aliases.
+#define B_ALIASES(X, fam, nm) X(fam, PARALLEL, nm) X(fam, SUPARA, nm) X(fam, SIMD, nm) X(fam, NOPARALLEL, nm)
+#define B_SIZES(X, fam) B_ALIASES(X, fam, 10) B_ALIASES(X, fam, 15) B_ALIASES(X, fam, 20) B_ALIASES(X, fam, 25) B_ALIASES(X, fam, 30)
+//The serial families do not take an alias.
+#define B_SERIAL_SIZES(X, fam) X(fam, SERIAL, 10) X(fam, SERIAL, 15) X(fam, SERIAL, 20) X(fam, SERIAL, 25) X(fam, SERIAL, 30)
+//Nor do the auto ones, which get every thread and pick for themselves.
+#define B_AUTO_SIZES(X, fam) X(fam, AUTO, 10) X(fam, AUTO, 15) X(fam, AUTO, 20) X(fam, AUTO, 25) X(fam, AUTO, 30)
+#define B_LIST(X)\
+B_SIZES(X, MULTIPLEX)\
+B_AUTO_SIZES(X, MULTIPLEX_AUTO)\
+B_SIZES(X, FUSED)\
+B_SIZES(X, GRAPH)\
+B_SIZES(X, INDEXED)\
+B_SERIAL_SIZES(X, SHUFFLE_IND8)\
+B_SERIAL_SIZES(X, SHUFFLE_IND16)\
+B_SERIAL_SIZES(X, SHUFFLE_IND32)\
+B_SIZES(X, SHUFFLE_IND32_ALIAS)\
+B_SERIAL_SIZES(X, INDEXED_EMPLACE)\
+B_SIZES(X, INDEXED_EMPLACE_ALIAS)\
+B_SERIAL_SIZES(X, SHARED_STATE)\
+B_SERIAL_SIZES(X, SHARED_STATE_PAIR)\
+B_SERIAL_SIZES(X, SHARED_STATE_WIND)\
+B_SIZES(X, SHARED_STATE_PRIVATE)\
+B_SIZES(X, REDUCE)\
+B_SIZES(X, SCAN)\
+B_SIZES(X, RO_SHARED_STATE)\
+B_SIZES(X, RO_SHARED_STATE_PAIR)\
+B_ALIASES(X, RO_SHARED_STATE10, 20) B_ALIASES(X, RO_SHARED_STATE10, 25)\
+B_ALIASES(X, RO_SHARED_STATE10_PAIR, 20) B_ALIASES(X, RO_SHARED_STATE10_PAIR, 25)\
+B_SIZES(X, HALVES)\
+B_SIZES(X, HALVES_PAIR)\
+B_SIZES(X, MULTIK8)\
+B_SIZES(X, MULTIK8_LIST)\
+B_SIZES(X, CHAIN1)\
+B_SIZES(X, TABLE1)\
+B_ALIASES(X, NLOGN, 10) B_ALIASES(X, NLOGN, 15)\
+B_ALIASES(X, NLOGN_PAIR, 10) B_ALIASES(X, NLOGN_PAIR, 15)\
+B_ALIASES(X, NLOGNRO, 10) B_ALIASES(X, NLOGNRO, 15)\
+B_ALIASES(X, NLOGNRO_BLOCKED, 10) B_ALIASES(X, NLOGNRO_BLOCKED, 15)\
+B_SIZES(X, DATA_EXTRACTION)
+
+#define B_DEF(fam, alias, nm) B_DEF_##fam(alias, nm)
+#define B_ROW(fam, alias, nm) B_ROW_##fam(alias, nm)
+
+B_LIST(B_DEF)
+
+typedef struct{
+	const char* family;
+	const char* alias;
+	int state;
+	int elem_state;
+	double invocations;
+	double bytes;
+	void (*run)(void*);
+} b_entry;
+
+static const b_entry b_table[] = {
+	B_LIST(B_ROW)
+};
+
+static int b_is_threaded(const b_entry* e){
+	return !strcmp(e->alias, "PARALLEL") || !strcmp(e->alias, "SUPARA");
+}
+
+//Run until at least min_seconds have passed, report the fastest call.
+static double b_measure(const b_entry* e, void* buf, double min_seconds){
+	double best = -1, total = 0;
+	e->run(buf); /*Warm up, fault in pages.*/
+	for(long reps = 0; total < min_seconds || reps < 3; reps++){
+		double t0 = b_now();
+		e->run(buf);
+		double t = b_now() - t0;
+		total += t;
+		if(best < 0 || t < best) best = t;
+	}
+	return best;
+}
+
+int main(int argc, char** argv){
+	int max_state = 30;
+	double min_seconds = 0.25;
+	if(argc > 1) max_state = atoi(argv[1]);
+	if(argc > 2) min_seconds = atof(argv[2]);
+	const size_t nentries = sizeof(b_table)/sizeof(b_table[0]);
+	int largest = 0;
+	for(size_t k = 0; k < nentries; k++)
+		if(b_table[k].state <= max_state && b_table[k].state > largest)
+			largest = b_table[k].state;
+	if(largest == 0) {fprintf(stderr, "Nothing to run at or below state%d\n", max_state); return 1;}
+	//Faulted in by every thread, so parallel rows are not all served by one NUMA node.
+	BYTE* buf = k8_alloc_bytes(STATE_SIZE(largest), K8_ALLOC_DEFAULT);
+	if(!buf) {fprintf(stderr, "Could not allocate a state%d\n", largest); return 1;}
+	for(size_t k = 0; k < STATE_SIZE(largest); k++) buf[k] = (BYTE)(k * 131 + 7);
+	const int maxthreads = b_max_threads();
+	puts("compiler,family,alias,state,elem_state,threads,invocations,bytes,seconds,ns_per_elem,gb_per_s");
+	for(size_t k = 0; k < nentries; k++){
+		const b_entry* e = b_table + k;
+		if(e->state > max_state) continue;
+		for(int t = strcmp(e->alias, "AUTO") ? 1 : maxthreads; t <= maxthreads; t = (t == maxthreads || t*2 <= maxthreads) ? t*2 : maxthreads){
+			b_set_threads(t);
+			double s = b_measure(e, buf, min_seconds);
+			printf("\"%s\",%s,%s,%d,%d,%d,%.0f,%.0f,%.9f,%.4f,%.4f\n",
+				B_COMPILER, e->family, e->alias, e->state, e->elem_state, t,
+				e->invocations, e->bytes, s, s * 1e9 / e->invocations, e->bytes / s / 1e9);
+			fflush(stdout);
+			if(!b_is_threaded(e)) break;
+		}
+		b_set_threads(maxthreads);
+	}
+	k8_free_bytes(buf, STATE_SIZE(largest));
+	return 0;
+}
@@ -0,0 +1,249 @@
+//Exhaustive domain sweeps.
+//Every state1, state2 and state3 kernel checked here is run on *every single input* it can take,
+//and compared against a native C reference. Mismatches and accuracy (in ULPs) are tabulated.
+//Usage: k8sweep.out [log2 of the number of state3 inputs to test, 32 is all of them]
+//Exits nonzero if any integer kernel disagrees with its reference, or the reduce/scan check fails.
+#include "kerneln.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+//Histogram buckets: 0, 1, 2, 3-4, 5-8, ... 2^30+, and one for NaN disagreement.
+#define SW_BUCKETS 33
+#define SW_NAN_BUCKET (SW_BUCKETS - 1)
+
+typedef struct{
+	uint64_t tested;
+	uint64_t mismatches;
+	uint64_t nonfinite; /*Finite input, non-finite output. Kernels are supposed to be complete.*/
+	uint64_t first_bad;
+	int has_bad;
+	uint64_t hist[SW_BUCKETS];
+	char pad[64];
+} sw_acc;
+
+static int sw_bucket(uint64_t ulps){
+	int b = 0;
+	if(ulps == 0) return 0;
+	ulps--;
+	while(ulps && b < SW_NAN_BUCKET - 1) {ulps >>= 1; b++;}
+	return b + 1 < SW_NAN_BUCKET ? b + 1 : SW_NAN_BUCKET - 1;
+}
+
+static void sw_bad(sw_acc* acc, uint64_t input){
+	acc->mismatches++;
+	if(!acc->has_bad || input < acc->first_bad) {acc->first_bad = input; acc->has_bad = 1;}
+}
+
+//Distance between two floats in units in the last place.
+static uint64_t sw_ulps(float a, float b){
+	int32_t ia, ib;
+	memcpy(&ia, &a, 4); memcpy(&ib, &b, 4);
+	if(ia < 0) ia = INT32_MIN - ia;
+	if(ib < 0) ib = INT32_MIN - ib;
+	return ia > ib ? (uint64_t)((int64_t)ia - ib) : (uint64_t)((int64_t)ib - ia);
+}
+
+static void sw_float(sw_acc* acc, uint64_t input, float in, float got, float want){
+	acc->tested++;
+	if(isfinite(in) && !isfinite(got)) acc->nonfinite++;
+	if(isnan(got) || isnan(want)){
+		if(isnan(got) != isnan(want)) {acc->hist[SW_NAN_BUCKET]++; sw_bad(acc, input);}
+		else acc->hist[0]++;
+		return;
+	}
+	uint64_t u = sw_ulps(got, want);
+	acc->hist[sw_bucket(u)]++;
+	if(u) sw_bad(acc, input);
+}
+
+/*
+Floating point kernels, state3.
+*/
+K8_SWEEP(sw_fsqrtf, k_fsqrtf_s3, 3, 0)
+K8_SWEEP(sw_fsqrt, k_fsqrt_s3, 3, 0)
+K8_SWEEP(sw_fisr, k_fisr, 3, 0)
+
+//The reference is what the kernel is *defined* to compute, sqrt(|x|).
+static void sw_check_sqrt(uint64_t first, uint64_t stride, const void* out, size_t len, void* accp){
+	const state3* o = out;
+	for(size_t k = 0; k < len; k++){
+		const uint64_t input = first + k * stride;
+		const float in = float_from_state3(to_state3(input));
+		sw_float(accp, input, in, float_from_state3(o[k]), sqrtf(fabsf(in)));
+	}
+}
+static void sw_check_fisr(uint64_t first, uint64_t stride, const void* out, size_t len, void* accp){
+	const state3* o = out;
+	for(size_t k = 0; k < len; k++){
+		const uint64_t input = first + k * stride;
+		const float in = float_from_state3(to_state3(input));
+		if(!(in > 0) || !isfinite(in)) continue; /*Outside of the domain of the approximation.*/
+		sw_float(accp, input, in, float_from_state3(o[k]), 1.0f / sqrtf(in));
+	}
+}
+
+/*
+K8_COMPLETE_ARITHMETIC(1,2,8): every pair of bytes.
+The references spell out Kernel8's definitions- shifts are masked, division by zero gives zero.
+*/
+typedef uint8_t (*sw_ref2)(uint8_t a, uint8_t b);
+static uint8_t sw_shl(uint8_t a, uint8_t b){return (uint8_t)(a << (b & 7));}
+static uint8_t sw_shr(uint8_t a, uint8_t b){return (uint8_t)(a >> (b & 7));}
+static uint8_t sw_and(uint8_t a, uint8_t b){return a & b;}
+static uint8_t sw_or(uint8_t a, uint8_t b){return a | b;}
+static uint8_t sw_xor(uint8_t a, uint8_t b){return a ^ b;}
+static uint8_t sw_add(uint8_t a, uint8_t b){return (uint8_t)(a + b);}
+static uint8_t sw_sub(uint8_t a, uint8_t b){return (uint8_t)(a - b);}
+static uint8_t sw_mul(uint8_t a, uint8_t b){return (uint8_t)(a * b);}
+static uint8_t sw_div(uint8_t a, uint8_t b){return b ? a / b : 0;}
+static uint8_t sw_mod(uint8_t a, uint8_t b){return b ? a % b : 0;}
+static uint8_t sw_sdiv(uint8_t a, uint8_t b){return (int8_t)b ? (uint8_t)((int8_t)a / (int8_t)b) : 0;}
+static uint8_t sw_smod(uint8_t a, uint8_t b){return (int8_t)b ? (uint8_t)((int8_t)a % (int8_t)b) : 0;}
+
+//The reference in use by the current sweep. Set before the (parallel) sweep starts, read-only during it.
+static sw_ref2 sw_current2;
+static void sw_check2(uint64_t first, uint64_t stride, const void* out, size_t len, void* accp){
+	const state2* o = out;
+	sw_acc* acc = accp;
+	for(size_t k = 0; k < len; k++){
+		const uint64_t input = first + k * stride;
+		const state2 in = to_state2(input);
+		const uint8_t a = from_state1(in.state1s[0]), b = from_state1(in.state1s[1]);
+		acc->tested++;
+		/*The result goes in the first byte, the second must be untouched.*/
+		if(from_state1(o[k].state1s[0]) != sw_current2(a, b) || from_state1(o[k].state1s[1]) != b){
+			acc->hist[SW_NAN_BUCKET]++;
+			sw_bad(acc, input);
+		} else acc->hist[0]++;
+	}
+}
+
+typedef uint8_t (*sw_ref1)(uint8_t a);
+static uint8_t sw_sneg(uint8_t a){return (uint8_t)(-1 * (int8_t)a);}
+static uint8_t sw_abs(uint8_t a){return (uint8_t)labs((int8_t)a);}
+static uint8_t sw_neg(uint8_t a){return (uint8_t)~a;}
+static uint8_t sw_incr(uint8_t a){return (uint8_t)(a + 1);}
+static uint8_t sw_decr(uint8_t a){return (uint8_t)(a - 1);}
+
+static sw_ref1 sw_current1;
+static void sw_check1(uint64_t first, uint64_t stride, const void* out, size_t len, void* accp){
+	const state1* o = out;
+	sw_acc* acc = accp;
+	for(size_t k = 0; k < len; k++){
+		const uint64_t input = first + k * stride;
+		acc->tested++;
+		if(from_state1(o[k]) != sw_current1((uint8_t)input)){
+			acc->hist[SW_NAN_BUCKET]++;
+			sw_bad(acc, input);
+		} else acc->hist[0]++;
+	}
+}
+
+#define SW_OPS2(X)\
+X(shl) X(shr) X(and) X(or) X(xor) X(add) X(sub) X(mul) X(div) X(mod) X(sdiv) X(smod)
+#define SW_OPS1(X)\
+X(sneg) X(abs) X(neg) X(incr) X(decr)
+
+#define SW_DEF(op) K8_SWEEP(sw_k_##op, k_##op##_s1, 2, 0)
+SW_OPS2(SW_DEF)
+#undef SW_DEF
+#define SW_DEF(op) K8_SWEEP(sw_k_##op, k_##op##_s1, 1, 0)
+SW_OPS1(SW_DEF)
+#undef SW_DEF
+
+//K8_REDUCE and K8_SCAN over a partial range long enough for K8_REDUCE_CHUNKS to cap the chunk count.
+//Element i holds i, element 0 is the accumulator.
+static inline void sw_k_add13(state14* c){
+	c->state13s[0].state3s[0] = to_state3(from_state3(c->state13s[0].state3s[0]) + from_state3(c->state13s[1].state3s[0]));
+}
+#define SW_CHUNKED_END 1101
+K8_REDUCE_PARTIAL(sw_reduce_chunked, sw_k_add13, 13, 14, 24, 1, SW_CHUNKED_END, 0, 0, 0)
+K8_SCAN_PARTIAL(sw_scan_chunked, sw_k_add13, 13, 14, 24, 1, SW_CHUNKED_END, 0, 0, 0)
+
+static void sw_chunked_fill(state24* s){
+	for(size_t i = 0; i < STATE_SIZE(24)/STATE_SIZE(13); i++) s->state13s[i].state3s[0] = to_state3(i);
+	s->state13s[0].state3s[0] = to_state3(0);
+}
+
+//Returns the number of wrong elements.
+static uint64_t sw_chunked(void){
+	static state24 s;
+	const size_t count = STATE_SIZE(24)/STATE_SIZE(13);
+	const uint32_t total = (SW_CHUNKED_END - 1) * SW_CHUNKED_END / 2;
+	uint64_t bad = 0;
+	sw_chunked_fill(&s);
+	sw_reduce_chunked(&s);
+	bad += from_state3(s.state13s[0].state3s[0]) != total;
+	for(size_t i = 1; i < count; i++) bad += from_state3(s.state13s[i].state3s[0]) != i;
+	printf("%-10s mismatches %llu\n", "reduce", (unsigned long long)bad);
+	const uint64_t reduced = bad;
+	sw_chunked_fill(&s);
+	sw_scan_chunked(&s);
+	bad += from_state3(s.state13s[0].state3s[0]) != total;
+	for(size_t i = 1; i < count; i++)
+		bad += from_state3(s.state13s[i].state3s[0]) != (i < SW_CHUNKED_END ? i * (i + 1) / 2 : i);
+	printf("%-10s mismatches %llu\n", "scan", (unsigned long long)(bad - reduced));
+	return bad;
+}
+
+typedef void (*sw_sweeper)(uint64_t, uint64_t, uint64_t, k8_sweep_check, void*, size_t);
+
+//Run one sweep, merge the per-thread accumulators and print a row. Returns the number of mismatches.
+static uint64_t sw_run(const char* name, sw_sweeper sweep, k8_sweep_check check, uint64_t count, uint64_t stride, int ulps){
+	const int nt = k8_max_threads();
+	sw_acc* accs = calloc(nt, sizeof(sw_acc));
+	sw_acc total;
+	memset(&total, 0, sizeof(total));
+	if(!accs) {puts("Out of memory!"); exit(1);}
+	const uint64_t t0 = k8_wtime_ns();
+	sweep(0, count, stride, check, accs, sizeof(sw_acc));
+	const double seconds = (k8_wtime_ns() - t0) * 1e-9;
+	for(int t = 0; t < nt; t++){
+		total.tested += accs[t].tested;
+		total.mismatches += accs[t].mismatches;
+		total.nonfinite += accs[t].nonfinite;
+		if(accs[t].has_bad && (!total.has_bad || accs[t].first_bad < total.first_bad))
+			{total.first_bad = accs[t].first_bad; total.has_bad = 1;}
+		for(int b = 0; b < SW_BUCKETS; b++) total.hist[b] += accs[t].hist[b];
+	}
+	free(accs);
+	printf("%-10s tested %11llu mismatches %11llu nonfinite %11llu  %8.3fs",
+		name, (unsigned long long)total.tested, (unsigned long long)total.mismatches,
+		(unsigned long long)total.nonfinite, seconds);
+	if(total.has_bad) printf("  first bad input 0x%llx", (unsigned long long)total.first_bad);
+	putchar('\n');
+	if(ulps){
+		printf("           ulps:");
+		for(int b = 0; b < SW_NAN_BUCKET; b++)
+			if(total.hist[b]) printf(" [%s%llu]=%llu", b > 1 ? "<=" : "",
+				b > 0 ? 1ull << (b - 1) : 0ull, (unsigned long long)total.hist[b]);
+		if(total.hist[SW_NAN_BUCKET]) printf(" [nan]=%llu", (unsigned long long)total.hist[SW_NAN_BUCKET]);
+		putchar('\n');
+	}
+	return total.mismatches;
+}
+
+int main(int argc, char** argv){
+	int bits = 32;
+	uint64_t failures = 0;
+	if(argc > 1) bits = atoi(argv[1]);
+	if(bits < 0 || bits > 32) {puts("Between 0 and 32 bits, please."); return 1;}
+	const uint64_t count3 = 1ull << bits;
+	const uint64_t stride3 = 1ull << (32 - bits);
+	printf("Sweeping %llu state3 inputs with %d threads.\n", (unsigned long long)count3, k8_max_threads());
+	puts("K8_COMPLETE_ARITHMETIC(1,2,8), every input:");
+#define SW_RUN(op) sw_current2 = sw_##op; failures += sw_run(#op, sw_k_##op, sw_check2, 1ull << 16, 1, 0);
+	SW_OPS2(SW_RUN)
+#undef SW_RUN
+#define SW_RUN(op) sw_current1 = sw_##op; failures += sw_run(#op, sw_k_##op, sw_check1, 1ull << 8, 1, 0);
+	SW_OPS1(SW_RUN)
+#undef SW_RUN
+	puts("K8_REDUCE and K8_SCAN, partial range with capped chunks:");
+	failures += sw_chunked();
+	puts("Floating point, against libm:");
+	sw_run("fsqrtf", sw_fsqrtf, sw_check_sqrt, count3, stride3, 1);
+	sw_run("fsqrt", sw_fsqrt, sw_check_sqrt, count3, stride3, 1);
+	sw_run("fisr", sw_fisr, sw_check_fisr, count3, stride3, 1);
+	return failures != 0;
+}
@@ -52,31 +52,35 @@ void k_fillerind(state4 *c){ //Real kernel using the "MultiplexIndexed" syntax.
 void k_mul5(state3 *c){
 	*c = to_state3(from_state3(*c)*5);
 }
+//k_mul5, but writing through K8_PORT_STORE so that writes into IO ports are seen.
+void k_mul5_port(state3 *c){
+	K8_PORT_STORE(*c, to_state3(from_state3(*c)*5));
+}
+//An IO port. Called with every write a kernel makes into it.
+static void fk_port_print(void* arg, size_t offset, const void* data, size_t len){
+	state3 v;
+	K8_UNUSED(arg);
+	K8_UNUSED(len);
+	memcpy(&v, data, sizeof(v));
+	printf("Port write at byte %zu: %u\n", offset, from_state3(v));
+}
 void k_modsort(state4 *c){ //Use the value at the index to choose its placement.
 	k_pat(c,0,3,4) = k_pat(c,1,3,4);
 }
 
 //Real variant of fk_printer! Using the "indexed" multiplex syntax.
 void fk_printerind(state4 *c){
-K_IO
-	printf("%u, %u\n", from_state3(k_pat(c,0,3,4)), from_state3(k_pat(c,1,3,4)));
-K_END_IO
+	K8_LOG(from_state3(k_pat(c,0,3,4)), "%u, %u\n", from_state3(k_pat(c,0,3,4)), from_state3(k_pat(c,1,3,4)));
 }
 
 void fk_printer(state3 *c){
-	K_IO
-		printf("As uint: %u\n", from_state3(*c));
-		printf("Byte 0: %u\n", from_state1(k_pat(c,0,1,3)));
-		printf("Byte 1: %u\n", from_state1(k_pat(c,1,1,3)));
-		printf("Byte 2: %u\n", from_state1(k_pat(c,2,1,3)));
-		printf("Byte 3: %u\n", from_state1(k_pat(c,3,1,3)));
-	K_END_IO
+	//One line in the log, so the five stay together.
+	K8_LOG(0, "As uint: %u\nByte 0: %u\nByte 1: %u\nByte 2: %u\nByte 3: %u\n", from_state3(*c),
+		from_state1(k_pat(c,0,1,3)), from_state1(k_pat(c,1,1,3)), from_state1(k_pat(c,2,1,3)), from_state1(k_pat(c,3,1,3)));
 }
 //Print individual bytes, with an 8 bit index.
 void fk_printer8ind(state2 *c){
-	K_IO
-		printf("BP! %u, %u\n", from_state1(state_high2(*c)), from_state1(state_low2(*c)));
-	K_END_IO
+	K8_LOG(from_state1(state_high2(*c)), "BP! %u, %u\n", from_state1(state_high2(*c)), from_state1(state_low2(*c)));
 }
 //Print individual bytes, with a 32 bit index.
 void fk_printer8ind32(state4 *c){
@@ -88,9 +92,7 @@ void fk_printer8ind32(state4 *c){
 										0, //start
 										4, //for i = start, i < end
 										1) //increment, i+= 1.
-		K_IO
-			printf("BP32! %u, %u\n", ind + (uint32_t)i, from_state1(*elem_i));
-		K_END_IO
+		K8_LOG(ind + (uint32_t)i, "BP32! %u, %u\n", ind + (uint32_t)i, from_state1(*elem_i));
 	TRAVERSAL_END
 }
 
@@ -104,9 +106,7 @@ static inline void big_shared_index(state5* c){
 	index--;
 	index *= 2;
 	//if this is the first iteration...
-	K_IO
-		printf("EXECUTING, INDEX=%u\n", index);
-	K_END_IO
+	K8_LOG(index, "EXECUTING, INDEX=%u\n", index);
 	if(index == 0){
 		//puts("First Iteration Detected. This should print exactly once.");
 		//write zero to shared variable.
@@ -140,6 +140,13 @@ K8_SHARED_STATE_WIND(big_shared_process20, //new name
 							1,//Where in the shared state should the index be written. (NOTE: the value at this location is restored post-call)
 							1,//Do we want to enable writing the index? (0 means same as SHARED_STATE)
 							0) //is our old kernel a copy-kernel?
+//The same process, in parallel. Every thread gets its own copy of the shared state4,
+//and the merge kernel folds them back together at the end:
+//[0] is the result so far, [1] the next thread's copy, [2] what they all started out as.
+static inline void big_shared_merge(state6* c){
+	c->state4s[0].state3s[0].u += c->state4s[1].state3s[0].u - c->state4s[2].state3s[0].u;
+}
+K8_SHARED_STATE_PRIVATE_WIND(big_shared_process20_private, big_shared_index, big_shared_merge, 4, 5, 6, 20, 3, 1, 1, 0)
 //Summer.
 void k_sum32(state4 *c){
 	uint32_t high = from_state3(state_high4(*c));
@@ -211,14 +218,25 @@ K8_SHARED_STATE_PARTIAL_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwi
 K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, alias)
 K8_MULTIPLEX_HALVES_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)
 K8_MULTIPLEX_MULTIK8_PARTIAL_ALIAS(name, funcarr, nn, nm, start, end, iscopy, alias)
+//list- an X-macro of kernels, #define LIST(X) X(k1) X(k2)... Element i gets kernel i modulo the list's length.
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, alias)
 //Nlogn functionality, an "i,j" nested loop
 //i = start; i < end - 1; i++
 //j = i+1; j < end; j++
-K8_MULTIPLEX_NLOGN_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)
+K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)
 K8_MULTIPLEX_NLOGNRO_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)
+//The _PAIR variants take a kernelpairpb##nn, func(state##nn* x, state##nn* y), pointing into the big state-
+//nothing is copied into a state##nnn and back. So there's no nnn and no iscopy.
+K8_SHARED_STATE_PAIR_PARTIAL_WIND(name, func, nn, nm, start, end, sharedind, nwind, whereind, doind)
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, alias)
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)
 //just like an ordinary multiplex but with an arbitrary number of bytes retrieved "nproc"
 //rather than the array being treated as an array of statenn's
 K8_MULTIPLEX_DATA_EXTRACTION_PARTIAL_ALIAS(name, func, nproc, nn, nm, start, end, iscopy, alias)
+//No alias- it times serial, SIMD and threaded runs on its first calls and keeps the fastest.
+K8_MULTIPLEX_AUTO(name, func, nn, nm, iscopy)
 */
 //Generate a multiplexing of and127 from state1 to state3.
 //Notice the SIMD parallelism hint,
@@ -237,6 +255,7 @@ K8_MULTIPLEX_SIMD(k_mul5_simd_mtp20, k_mul5, 3, 20, 0)
 
 //This one uses the maximum available parallelism on the system
 K8_MULTIPLEX(k_mul5_mtp20, k_mul5, 3, 20, 0)
+K8_MULTIPLEX(k_mul5_port_mtp20, k_mul5_port, 3, 20, 0)
 
 //Multiplex is_prime by pointer to state20.
 K8_MULTIPLEX(is_prime_mtp20, is_prime, 3, 20, 0)
@@ -279,6 +298,9 @@ K8_SHUFFLE_IND32(k_shuffler1_3_20, k_add1_3, 3, 20, 0)
 //Shared state worker.
 //sharedp stands for "shared pointer". it is a pass-by-pointer shared-type algorithm kernel
 K8_SHARED_STATE(k_sum32_sharedp3_20, k_sum32, 3, 4, 20, 0)
+//k_sum32 is associative and commutative, so the same sum can be done as a parallel reduction.
+//The last argument says it's commutative- partials are merged in whatever order they finish.
+K8_REDUCE(k_sum32_reduce3_20, k_sum32, 3, 4, 20, 0, 1)
 
 //K8_MULTIPLEX_HALVES(name, func, nn, nnn, nm, iscopy)
 //Treat the halves of a state20 as two separate arrays.
@@ -306,6 +328,13 @@ K8_MULTIPLEX_NLOGNRO(k_upper3_4_increment_nlognrop20, k_upper3_4_increment, 3, 4
 //create NEW kernels.
 //This has *infinite possibilities*.
 K8_MULTIPLEX_SUPARA(k_dupe_upper4_sharedp3_20_mtp30,k_dupe_upper4_sharedp3_20, 20, 30,0)
+//Fill, ifunc and dupe, one after another, are three sweeps over all 512 megabytes.
+//Fused, each tile of it gets all three while it's still in cache.
+//The last stage works on whole state20's, so that's what the tiles have to be made of (the 20).
+K8_FUSED_STAGE_INDEXED(k_fillerind_stage30, k_fillerind, 3, 4, 30, 0)
+K8_FUSED_STAGE(k_ifunc_stage30, k_ifunc, 3, 30, 0)
+K8_FUSED_STAGE(k_dupe_upper4_sharedp3_20_stage30, k_dupe_upper4_sharedp3_20, 20, 30, 0)
+K8_MULTIPLEX_FUSED(k_fill_ifunc_dupe_fused30, 30, 20, k_fillerind_stage30, k_ifunc_stage30, k_dupe_upper4_sharedp3_20_stage30)
 
 //Extract arbitrary data for multiplexing
 /*
@@ -324,15 +353,10 @@ K8_MULTIPLEX_DATA_EXTRACTION_NP(fk_byteprinter_extract3, //new kernel name
 //Wow this is really unsafe...
 //K8_MULTIPLEX_DATA_EXTRACTION_SUPARA(fk_byteprinter_extract3_supara, fk_printer, 2, 3, 20, 0)
 
-static kernelpb1 and_7667_funcs[4] = {
-	and127,
-	and63,
-	and63,
-	and127
-};
-//Multikernel
-
-K8_MULTIPLEX_MULTIK8_NP(and_7667, and_7667_funcs, 1, 3, 0);
+//Multikernel. The kernels are listed at compile time, so they're all inlined
+//and and_7667_big is one AND with a 4 byte mask.
+#define AND_7667_KERNELS(X) X(and127) X(and63) X(and63) X(and127)
+K8_MULTIPLEX_MULTIK8_LIST_NP(and_7667, AND_7667_KERNELS, 1, 3, 0);
 
 K8_MULTIPLEX(and_7667_big, and_7667, 3, 30, 0);
 void and_7667_2(state3* c){
@@ -481,7 +505,7 @@ int main(int argc, char** argv){
 			fgetc(stdin);
 			system("clear");
 			
-			puts("Testing nlogn (non rop, non parallel) this may take a while.");
+			puts("Testing nlogn (non rop, tiled parallel) this may take a while.");
 			s20.state3s[0] = to_state3(1);
 			k_dupe_upper4_sharedp3_20(&s20); //Fill it with 1's
 			k_incrementhalves4_nlognp20(&s20); //Run our nlogn algo.
@@ -495,6 +519,9 @@ int main(int argc, char** argv){
 		//result should be 1 less than the count.
 		s20.state3s[0] = to_state3(1);
 		k_dupe_upper4_sharedp3_20(&s20);
+		k_sum32_reduce3_20(&s20);
+		printf("Reduced sum is %u\n",from_state3(s20.state3s[0]));
+		s20.state3s[0] = to_state3(1);
 		k_sum32_sharedp3_20(&s20);
 		printf("Sum is %u",from_state3(s20.state3s[0]));
 		puts("Press enter to continue, but don't type anything.");
@@ -517,9 +544,29 @@ int main(int argc, char** argv){
 		fgetc(stdin);
 		big_shared_process20(&s20);
 		fk_printerind_np_mtpi20(&s20);
+		{
+			const uint32_t counter = s20.state3s[0].u;
+			s20.state3s[0] = to_state3(24);
+			k_dupe_upper4_sharedp3_20(&s20);
+			big_shared_process20_private(&s20);
+			printf("Shared counter %u, privatized shared counter %u\n", counter, s20.state3s[0].u);
+		}
 		puts("Press enter to continue, but don't type anything.");
 				fgetc(stdin);
 		system("clear");
+		//IO ports. Every write into state10s[157] is printed as it happens,
+		//rather than copying state10s[157] out after the call and looking at it.
+		puts("Testing IO ports...");
+		k_fillerind_mtpi20(&s20);
+		{
+			const int port = k8_port_open(s20.state10s + 157, sizeof(state10), fk_port_print, NULL);
+			k_mul5_port_mtp20(&s20);
+			k8_port_sync();
+			k8_port_close(port);
+		}
+		puts("Press enter to continue, but don't type anything.");
+		fgetc(stdin);
+		system("clear");
 	}
 	//Perform ifunc on all elements in a huge array. Then, run the duplication function.
 	//As you can imagine, this takes a very long time.
@@ -538,6 +585,12 @@ int main(int argc, char** argv){
 		puts("Press enter to continue, but don't type anything.");
 		fgetc(stdin);
 		fk_printerind_np_mtpi30(&hughmong);
+		//All three again, in one pass. Same answer.
+		{
+			const uint64_t t0 = k8_wtime_ns();
+			k_fill_ifunc_dupe_fused30(&hughmong);
+			printf("Fused fill, ifunc and dupe took %.3f seconds.\n", (k8_wtime_ns() - t0) * 1e-9);
+		}
 	}
 	{state34 *bruh = malloc(sizeof(state34));
 	if(bruh){
@@ -107,24 +107,44 @@ Known special properties of kernels
 
 #ifndef PRAGMA_PARALLEL
 #define PRAGMA_PARALLEL _Pragma("omp parallel for")
-#define PRAGMA_SUPARA _Pragma("omp parallel for")
 #endif
 
+/*
+SUPARA is all the parallelism the machine has.
+Without an accelerator that's two levels, like the teams of a GPU: one team of threads per NUMA node
+(k8_supara_teams), each team taking its own contiguous part of the loop and splitting it between its threads
+(k8_supara_team_threads). Run with OMP_PLACES=numa_domains OMP_PROC_BIND=spread,close to keep each team on
+its own node, next to its part of the state (if the state was first touched the same way, see k8_alloc_state).
+With one node it's one team, which is a plain parallel for.
+Host teams can only be started outside of every parallel region, so a SUPARA multiplexer called from inside one
+(a graph node, a FUSED or AUTO stage, a PARALLEL kernel) runs as a PRAGMA_PARALLEL loop instead, see k8_supara_for.
+Define K8_SUPARA_OFFLOAD to offload SUPARA loops to an accelerator instead.
+*/
 #ifndef PRAGMA_SUPARA
-
-#ifdef __clang__
-//Mitigate issue compiling with clang- openmp offloading is BUGGED!
-//#define PRAGMA_SUPARA _Pragma("omp parallel for")
-#else
+#if defined(K8_SUPARA_OFFLOAD) && !defined(__clang__)
 #define PRAGMA_SUPARA _Pragma("omp target teams distribute parallel for")
+#else
+//Mitigate issue compiling with clang- openmp offloading is BUGGED! Clang always gets the host teams.
+#define PRAGMA_SUPARA _Pragma("omp teams distribute parallel for num_teams(k8_supara_teams()) thread_limit(k8_supara_team_threads())")
+#define K8_SUPARA_HOST_TEAMS
 #endif
-//#define PRAGMA_SUPARA _Pragma("omp target parallel for")
 #endif
 
 #ifndef PRAGMA_SIMD
 #define PRAGMA_SIMD _Pragma("omp simd")
 #endif
 
+//A parallel region and the worksharing loops inside of it, for multiplexers which run a sequence of parallel loops
+//(the NLOGN wavefronts) without forking and joining for each one. Every PRAGMA_FOR_* ends in a barrier.
+#ifndef PRAGMA_REGION_PARALLEL
+#define PRAGMA_REGION_PARALLEL _Pragma("omp parallel")
+#define PRAGMA_FOR_PARALLEL _Pragma("omp for schedule(dynamic, 1)")
+#endif
+#ifndef PRAGMA_REGION_SUPARA
+#define PRAGMA_REGION_SUPARA _Pragma("omp parallel")
+#define PRAGMA_FOR_SUPARA _Pragma("omp for schedule(dynamic, 1)")
+#endif
+
 #ifndef K_IO
 #define K_IO _Pragma("omp critical") {
 #define K_END_IO }
@@ -135,10 +155,20 @@ Known special properties of kernels
 #define PRAGMA_PARALLEL /*a comment */
 #define PRAGMA_SUPARA /*a comment*/
 #define PRAGMA_SIMD /*a comment*/
+#define PRAGMA_REGION_PARALLEL /*a comment*/
+#define PRAGMA_FOR_PARALLEL /*a comment*/
+#define PRAGMA_REGION_SUPARA /*a comment*/
+#define PRAGMA_FOR_SUPARA /*a comment*/
 #define K_IO {
 #define K_END_IO }
 #endif
 
+//A tiled loop isn't a simd loop, so these are serial.
+#define PRAGMA_REGION_SIMD /*a comment*/
+#define PRAGMA_FOR_SIMD /*a comment*/
+#define PRAGMA_REGION_NOPARALLEL /*a comment*/
+#define PRAGMA_FOR_NOPARALLEL /*a comment*/
+
 //TODO: use compiler optimization hints to tell the compiler that values are never used for the duration of a function.
 //Indicate to the compiler that state variables go unused AND unmodified.
 #ifndef K8_UNUSED
@@ -160,7 +190,9 @@ Known special properties of kernels
 
 #ifndef K8_DEBUG_PRINT
 
-#ifdef K8_DEBUG
+#if defined(K8_DEBUG) && defined(K8_LOG_BUFFERED)
+#define K8_DEBUG_PRINT(...) k8_log_printf(stderr, 0, __func__, __VA_ARGS__)
+#elif defined(K8_DEBUG)
 #define K8_DEBUG_PRINT(...) fprintf (stderr, __VA_ARGS__)
 #else
 #define K8_DEBUG_PRINT(...) /*a comment*/
@@ -190,6 +222,1169 @@ Known special properties of kernels
 
 #endif
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#endif
+
+//Thread-local storage. gnu99 does not have _Thread_local.
+#ifndef K8_THREAD_LOCAL
+#define K8_THREAD_LOCAL __thread
+#endif
+
+//Monotonic wall clock, in nanoseconds.
+static inline uint64_t k8_wtime_ns(){
+#if defined(_OPENMP)
+	return (uint64_t)(omp_get_wtime() * 1e9);
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+#endif
+}
+
+//Which thread of the current team is this, and how many threads can a parallel region have.
+static inline int k8_thread_num(){
+#if defined(_OPENMP)
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+static inline int k8_max_threads(){
+#if defined(_OPENMP)
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+//Reads a Linux list of ranges, like "0-3,8,10-11", calling fn (if not NULL) on each one.
+//Returns how many numbers are in the list, 0 if it can't be read.
+static inline int k8_read_ranges(const char* path, void (*fn)(void* arg, unsigned lo, unsigned hi), void* arg){
+	int n = 0;
+	unsigned lo, hi;
+	FILE* f = fopen(path, "r");
+	if(!f) return 0;
+	while(fscanf(f, "%u", &lo) == 1){
+		int c = fgetc(f);
+		hi = lo;
+		if(c == '-') {if(fscanf(f, "%u", &hi) != 1) break; c = fgetc(f);}
+		if(fn) fn(arg, lo, hi);
+		n += hi - lo + 1;
+		if(c != ',') break;
+	}
+	fclose(f);
+	return n;
+}
+
+//How many NUMA nodes there are. The K8_NUMA_NODES environment variable overrides it.
+static inline int k8_numa_nodes(){
+	static int nodes = 0;
+	int n = __atomic_load_n(&nodes, __ATOMIC_RELAXED);
+	if(n) return n;
+	const char* env = getenv("K8_NUMA_NODES");
+	n = env ? atoi(env) : k8_read_ranges("/sys/devices/system/node/online", NULL, NULL);
+	if(n < 1) n = 1;
+	__atomic_store_n(&nodes, n, __ATOMIC_RELAXED);
+	return n;
+}
+
+//The two levels of SUPARA: teams, one per NUMA node, and the threads of each team.
+static inline int k8_supara_teams(){
+	const int nodes = k8_numa_nodes(), threads = k8_max_threads();
+	return nodes < threads ? nodes : threads;
+}
+static inline int k8_supara_team_threads(){
+	const int per = k8_max_threads() / k8_supara_teams();
+	return per > 0 ? per : 1;
+}
+
+/*
+Profiling.
+Compile with K8_PROFILE defined and every function generated by the
+K8_MULTIPLEX_*, K8_SHARED_STATE_*, K8_RO_SHARED_STATE_* and K8_SHUFFLE_* macros
+records its call count, wall time, elements processed and bytes read and written.
+Time is inclusive- a multiplexer of a multiplexer counts the time of the inner one too.
+Counters are kept per thread and merged when the program exits. The merged table goes to stderr,
+or as JSON to the file named by the K8_PROFILE_JSON environment variable.
+Every translation unit keeps (and prints) its own table, just like every other static in this header.
+Without K8_PROFILE the hooks are comments, like K8_DEBUG_PRINT.
+*/
+#ifdef K8_PROFILE
+
+#ifndef K8_PROFILE_MAX_THREADS
+#define K8_PROFILE_MAX_THREADS 64
+#endif
+
+typedef struct{
+	uint64_t calls;
+	uint64_t nanoseconds;
+	uint64_t elements;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	char pad[64 - 5 * sizeof(uint64_t)];
+} __attribute__((aligned(64))) k8_prof_slot; /*One cache line per thread. K8_ALIGN is off, so it's spelled out.*/
+
+typedef struct k8_prof_rec{
+	const char* name;
+	struct k8_prof_rec* next;
+	int registered;
+	k8_prof_slot slots[K8_PROFILE_MAX_THREADS];
+} k8_prof_rec;
+
+static k8_prof_rec* k8_prof_head = NULL;
+static int k8_prof_threads = 0;
+static K8_THREAD_LOCAL int k8_prof_tid = -1;
+
+static inline void k8_prof_total(k8_prof_rec* r, k8_prof_slot* out){
+	memset(out, 0, sizeof(*out));
+	for(int t = 0; t < K8_PROFILE_MAX_THREADS; t++){
+		out->calls += r->slots[t].calls;
+		out->nanoseconds += r->slots[t].nanoseconds;
+		out->elements += r->slots[t].elements;
+		out->bytes_read += r->slots[t].bytes_read;
+		out->bytes_written += r->slots[t].bytes_written;
+	}
+}
+
+typedef struct{
+	const char* name;
+	k8_prof_slot sum;
+} k8_prof_row;
+
+//Most expensive first.
+static int k8_prof_cmp(const void* a, const void* b){
+	const uint64_t x = ((const k8_prof_row*)a)->sum.nanoseconds, y = ((const k8_prof_row*)b)->sum.nanoseconds;
+	return (x < y) - (x > y);
+}
+
+static void k8_prof_dump(void){
+	const char* path = getenv("K8_PROFILE_JSON");
+	size_t n = 0;
+	for(k8_prof_rec* r = k8_prof_head; r; r = r->next) n++;
+	k8_prof_row* totals = calloc(n ? n : 1, sizeof(k8_prof_row));
+	if(!totals) return;
+	n = 0;
+	for(k8_prof_rec* r = k8_prof_head; r; r = r->next, n++){
+		totals[n].name = r->name;
+		k8_prof_total(r, &totals[n].sum);
+	}
+	qsort(totals, n, sizeof(k8_prof_row), k8_prof_cmp);
+	FILE* f = path ? fopen(path, "w") : NULL;
+	if(f) fputs("[\n", f);
+	else fprintf(stderr, "%-48s %12s %14s %16s %16s %16s\n", "K8_PROFILE kernel", "calls", "seconds", "elements", "bytes read", "bytes written");
+	for(size_t k = 0; k < n; k++){
+		const k8_prof_slot* s = &totals[k].sum;
+		const char* name = totals[k].name;
+		if(f)
+			fprintf(f, "{\"kernel\":\"%s\",\"calls\":%llu,\"seconds\":%.9f,\"elements\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu}%s\n",
+				name, (unsigned long long)s->calls, s->nanoseconds * 1e-9, (unsigned long long)s->elements,
+				(unsigned long long)s->bytes_read, (unsigned long long)s->bytes_written, k+1 < n ? "," : "");
+		else
+			fprintf(stderr, "%-48s %12llu %14.6f %16llu %16llu %16llu\n",
+				name, (unsigned long long)s->calls, s->nanoseconds * 1e-9, (unsigned long long)s->elements,
+				(unsigned long long)s->bytes_read, (unsigned long long)s->bytes_written);
+	}
+	if(f) {fputs("]\n", f); fclose(f);}
+	free(totals);
+}
+
+static inline void k8_prof_add(k8_prof_rec* r, uint64_t ns, uint64_t elements, uint64_t rd, uint64_t wr){
+	if(!__atomic_load_n(&r->registered, __ATOMIC_ACQUIRE)){
+		int expected = 0;
+		if(__atomic_compare_exchange_n(&r->registered, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			r->next = __atomic_load_n(&k8_prof_head, __ATOMIC_ACQUIRE);
+			while(!__atomic_compare_exchange_n(&k8_prof_head, &r->next, r, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+			if(r->next == NULL) atexit(k8_prof_dump);
+		}
+	}
+	if(k8_prof_tid < 0) k8_prof_tid = __atomic_fetch_add(&k8_prof_threads, 1, __ATOMIC_RELAXED);
+	/*Past K8_PROFILE_MAX_THREADS threads share slots, which is why these are atomic.*/
+	k8_prof_slot* s = r->slots + (k8_prof_tid % K8_PROFILE_MAX_THREADS);
+	__atomic_fetch_add(&s->calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->nanoseconds, ns, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->elements, elements, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->bytes_read, rd, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->bytes_written, wr, __ATOMIC_RELAXED);
+}
+
+//name is expanded first, so generated names (name##_to) are reported as themselves.
+#define K8_PROFILE_BEGIN(name) K8_PROFILE_BEGIN_NAMED(name)
+#define K8_PROFILE_BEGIN_NAMED(name)\
+	static k8_prof_rec k8_prof_rec_local = {#name};\
+	const uint64_t k8_prof_t0 = k8_wtime_ns();
+#define K8_PROFILE_END(elements, rd, wr)\
+	k8_prof_add(&k8_prof_rec_local, k8_wtime_ns() - k8_prof_t0, (uint64_t)(elements), (uint64_t)(rd), (uint64_t)(wr));
+
+#else
+#define K8_PROFILE_BEGIN(name) /*a comment*/
+#define K8_PROFILE_END(elements, rd, wr) /*a comment*/
+#endif
+
+/*
+Buffered logging.
+K8_LOG(seq, format, ...) is printf for kernels, under K_IO. seq is the iteration the line belongs to-
+usually the index the kernel was handed- and it's what orders the output.
+By default K8_LOG is a printf inside of K_IO, which is one global critical section.
+Compile with K8_LOG_BUFFERED defined (and link with -pthread) and every thread formats its lines into its
+own ring of K8_LOG_RING records instead, with no locks. A background flusher thread empties the rings
+and writes the lines out in passes. Every parallel loop started outside of any other is a pass, and within
+one the lines are sorted by seq (then by thread, then in the order each thread logged it), so a parallel
+multiplexer prints in iteration order. Outside of parallel loops every line is a pass of its own, in the
+order it was logged. A pass goes out as soon as the next one starts. Before that the flusher writes on its
+own once it is holding K8_LOG_HOLD lines, but only lines whose seq is below every seq that the pass's
+threads can still log- which holds as long as each thread logs its seqs in increasing order (like the
+contiguous share a parallel loop gives it). A thread which hasn't logged in the pass yet holds the whole
+pass back, as it could still log seq 0.
+k8_log_flush() writes everything logged so far and starts a new pass, for when the lines have to be out
+before printing something else. Everything left is written at exit.
+Lines longer than K8_LOG_LINE bytes are cut short.
+With the K8_LOG_TAGS environment variable set, every line starts with the name of the kernel that logged it,
+in angle brackets (README item 16).
+K8_DEBUG_PRINT goes through the same rings (to stderr), so debug builds don't serialize on it either.
+*/
+#ifdef K8_LOG_BUFFERED
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifndef K8_LOG_MAX_THREADS
+#define K8_LOG_MAX_THREADS 64
+#endif
+//Records per thread. A power of 2.
+#ifndef K8_LOG_RING
+#define K8_LOG_RING 1024
+#endif
+#ifndef K8_LOG_LINE
+#define K8_LOG_LINE 256
+#endif
+#ifndef K8_LOG_HOLD
+#define K8_LOG_HOLD (1<<16)
+#endif
+
+typedef struct{
+	uint64_t pass;
+	uint64_t seq;
+	uint64_t order;
+	const char* tag;
+	FILE* out;
+	uint32_t tid;
+	uint32_t len;
+	char text[K8_LOG_LINE];
+} k8_log_rec;
+
+typedef struct{
+	size_t head; /*Written by the thread that owns the ring.*/
+	uint64_t last; /*The highest seq it has logged in pass lastpass.*/
+	uint64_t lastpass; /*The pass it logged in last. Stored after last.*/
+	char pad0[64 - sizeof(size_t) - 2*sizeof(uint64_t)];
+	size_t tail; /*Written by whoever holds k8_log_lock.*/
+	char pad1[64 - sizeof(size_t)];
+	k8_log_rec recs[K8_LOG_RING];
+} k8_log_ring;
+
+static k8_log_ring* k8_log_rings[K8_LOG_MAX_THREADS];
+static int k8_log_threads = 0;
+static K8_THREAD_LOCAL int k8_log_tid = -1;
+static K8_THREAD_LOCAL uint64_t k8_log_order = 0;
+static uint64_t k8_log_passes = 0; /*The pass being logged.*/
+static int k8_log_team = 1; /*How many threads the pass runs on. Stored before k8_log_passes.*/
+//Everything below is guarded by k8_log_lock.
+static pthread_mutex_t k8_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static k8_log_rec* k8_log_pending = NULL;
+static size_t k8_log_npending = 0;
+static size_t k8_log_cappending = 0;
+static int k8_log_tags = 0;
+static int k8_log_running = 0;
+static pthread_t k8_log_thread;
+static pthread_once_t k8_log_once = PTHREAD_ONCE_INIT;
+static uint64_t k8_log_emitted = 0; /*The pass of the watermark at the last write.*/
+
+//Further down, once the backends are there.
+static inline int k8_log_toplevel();
+static inline void k8_log_pass();
+
+static inline void k8_log_nap(){
+	const struct timespec t = {0, 100000};
+	nanosleep(&t, NULL);
+}
+
+static inline void k8_log_pend(const k8_log_rec* r){
+	if(k8_log_npending == k8_log_cappending){
+		k8_log_cappending = k8_log_cappending ? k8_log_cappending * 2 : 1024;
+		k8_log_pending = realloc(k8_log_pending, k8_log_cappending * sizeof(k8_log_rec));
+		if(!k8_log_pending) {fputs("k8_log: out of memory.\n", stderr); abort();}
+	}
+	memcpy(k8_log_pending + k8_log_npending++, r, offsetof(k8_log_rec, text) + r->len);
+}
+
+//Move every published record out of the rings. Returns how many moved.
+static size_t k8_log_drain(){
+	size_t moved = 0;
+	int n = __atomic_load_n(&k8_log_threads, __ATOMIC_ACQUIRE);
+	if(n > K8_LOG_MAX_THREADS) n = K8_LOG_MAX_THREADS;
+	for(int t = 0; t < n; t++){
+		k8_log_ring* r = __atomic_load_n(k8_log_rings + t, __ATOMIC_ACQUIRE);
+		if(!r) continue;
+		const size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		size_t i = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+		for(; i != head; i++, moved++) k8_log_pend(r->recs + (i & (K8_LOG_RING - 1)));
+		__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+	}
+	return moved;
+}
+
+static int k8_log_cmp(const void* a, const void* b){
+	const k8_log_rec* x = *(const k8_log_rec* const*)a;
+	const k8_log_rec* y = *(const k8_log_rec* const*)b;
+	if(x->pass != y->pass) return x->pass < y->pass ? -1 : 1;
+	if(x->seq != y->seq) return x->seq < y->seq ? -1 : 1;
+	if(x->tid != y->tid) return x->tid < y->tid ? -1 : 1;
+	return (x->order > y->order) - (x->order < y->order);
+}
+
+static inline int k8_log_below(const k8_log_rec* r, uint64_t pass, uint64_t seq){
+	return r->pass < pass || (r->pass == pass && r->seq < seq);
+}
+
+//Write the pending lines below pass and seq, in order, and keep the rest.
+//Records are big, so it's pointers to them which get sorted.
+static void k8_log_emit(uint64_t pass, uint64_t seq){
+	const k8_log_rec** sorted = malloc((k8_log_npending ? k8_log_npending : 1) * sizeof(k8_log_rec*));
+	size_t n = 0, kept = 0;
+	if(!sorted) {fputs("k8_log: out of memory.\n", stderr); abort();}
+	for(size_t i = 0; i < k8_log_npending; i++)
+		if(k8_log_below(k8_log_pending + i, pass, seq)) sorted[n++] = k8_log_pending + i;
+	qsort(sorted, n, sizeof(k8_log_rec*), k8_log_cmp);
+	for(size_t i = 0; i < n; i++){
+		const k8_log_rec* r = sorted[i];
+		if(k8_log_tags && r->tag) fprintf(r->out, "<%s> ", r->tag);
+		fwrite(r->text, 1, r->len, r->out);
+	}
+	free(sorted);
+	for(size_t i = 0; i < k8_log_npending && n; i++)
+		if(!k8_log_below(k8_log_pending + i, pass, seq)){
+			if(kept != i) memcpy(k8_log_pending + kept, k8_log_pending + i, offsetof(k8_log_rec, text) + k8_log_pending[i].len);
+			kept++;
+		}
+	k8_log_npending = n ? kept : k8_log_npending;
+	fflush(stdout);
+	fflush(stderr);
+}
+
+//The lowest pass and seq any thread can still log, given each thread's seqs increase within a pass.
+//Read before draining. A thread which hasn't logged in this pass yet could still log seq 0,
+//and so could one which hasn't logged at all while there are fewer rings than the pass has threads.
+static void k8_log_watermark(uint64_t* pass, uint64_t* seq){
+	const uint64_t cur = __atomic_load_n(&k8_log_passes, __ATOMIC_ACQUIRE);
+	int n = __atomic_load_n(&k8_log_threads, __ATOMIC_ACQUIRE);
+	if(n > K8_LOG_MAX_THREADS) n = K8_LOG_MAX_THREADS;
+	*pass = *seq = UINT64_MAX;
+	if(n < __atomic_load_n(&k8_log_team, __ATOMIC_RELAXED)) {*pass = cur; *seq = 0; return;}
+	for(int t = 0; t < n; t++){
+		k8_log_ring* r = __atomic_load_n(k8_log_rings + t, __ATOMIC_ACQUIRE);
+		if(!r) {*pass = cur; *seq = 0; return;} /*Being set up, it's about to log.*/
+		const uint64_t lastpass = __atomic_load_n(&r->lastpass, __ATOMIC_ACQUIRE);
+		const uint64_t last = lastpass < cur ? 0 : __atomic_load_n(&r->last, __ATOMIC_RELAXED);
+		const uint64_t p = lastpass < cur ? cur : lastpass;
+		if(p < *pass || (p == *pass && last < *seq)) {*pass = p; *seq = last;}
+	}
+}
+
+static void* k8_log_flusher(void* unused){
+	K8_UNUSED(unused);
+	while(__atomic_load_n(&k8_log_running, __ATOMIC_ACQUIRE)){
+		pthread_mutex_lock(&k8_log_lock);
+		uint64_t pass, seq;
+		k8_log_watermark(&pass, &seq);
+		const size_t moved = k8_log_drain();
+		/*Once a pass is over nothing more can come in it, so it goes out straight away.*/
+		if(k8_log_npending && (k8_log_npending >= K8_LOG_HOLD || pass > k8_log_emitted)){
+			k8_log_emit(pass, seq);
+			k8_log_emitted = pass;
+		}
+		pthread_mutex_unlock(&k8_log_lock);
+		if(!moved) k8_log_nap();
+	}
+	return NULL;
+}
+
+//Write everything logged so far. Lines still being logged by other threads go out with the next flush.
+//What's logged after it is a new pass.
+static void k8_log_flush(){
+	pthread_mutex_lock(&k8_log_lock);
+	k8_log_drain();
+	k8_log_emit(UINT64_MAX, UINT64_MAX);
+	k8_log_emitted = __atomic_add_fetch(&k8_log_passes, 1, __ATOMIC_ACQ_REL);
+	pthread_mutex_unlock(&k8_log_lock);
+}
+
+static void k8_log_exit(){
+	if(__atomic_exchange_n(&k8_log_running, 0, __ATOMIC_ACQ_REL)) pthread_join(k8_log_thread, NULL);
+	k8_log_flush();
+}
+
+static void k8_log_start(){
+	k8_log_tags = getenv("K8_LOG_TAGS") != NULL;
+	__atomic_store_n(&k8_log_running, 1, __ATOMIC_RELEASE);
+	if(pthread_create(&k8_log_thread, NULL, k8_log_flusher, NULL)) __atomic_store_n(&k8_log_running, 0, __ATOMIC_RELEASE);
+	atexit(k8_log_exit);
+}
+
+//This thread's ring, or NULL past K8_LOG_MAX_THREADS threads.
+static inline k8_log_ring* k8_log_ring_get(){
+	if(k8_log_tid < 0){
+		pthread_once(&k8_log_once, k8_log_start);
+		k8_log_tid = __atomic_fetch_add(&k8_log_threads, 1, __ATOMIC_ACQ_REL);
+		if(k8_log_tid < K8_LOG_MAX_THREADS){
+			k8_log_ring* r = calloc(1, sizeof(k8_log_ring));
+			if(!r) {fputs("k8_log: out of memory.\n", stderr); abort();}
+			__atomic_store_n(k8_log_rings + k8_log_tid, r, __ATOMIC_RELEASE);
+		}
+	}
+	return k8_log_tid < K8_LOG_MAX_THREADS ? k8_log_rings[k8_log_tid] : NULL;
+}
+
+static inline void k8_log_format(k8_log_rec* r, FILE* out, uint64_t pass, uint64_t seq, const char* tag, const char* fmt, va_list ap){
+	const int len = vsnprintf(r->text, K8_LOG_LINE, fmt, ap);
+	r->pass = pass;
+	r->seq = seq;
+	r->order = k8_log_order++;
+	r->tag = tag;
+	r->out = out;
+	r->tid = (uint32_t)k8_log_tid;
+	r->len = len < 0 ? 0 : (len < K8_LOG_LINE ? (uint32_t)len : K8_LOG_LINE - 1);
+}
+
+static void k8_log_printf(FILE* out, uint64_t seq, const char* tag, const char* fmt, ...){
+	va_list ap;
+	k8_log_ring* r = k8_log_ring_get();
+	/*Outside of any parallel loop every line is a pass of its own, so they go out in the order they're logged.*/
+	if(k8_log_toplevel()){
+		__atomic_store_n(&k8_log_team, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&k8_log_passes, 1, __ATOMIC_RELEASE);
+	}
+	const uint64_t pass = __atomic_load_n(&k8_log_passes, __ATOMIC_ACQUIRE);
+	va_start(ap, fmt);
+	if(r){
+		const size_t h = r->head;
+		/*The ring is full, so the flusher is behind. Rather than wait for it, do its job.*/
+		while(h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= K8_LOG_RING){
+			pthread_mutex_lock(&k8_log_lock);
+			k8_log_drain();
+			pthread_mutex_unlock(&k8_log_lock);
+		}
+		/*Before the record is published, so the flusher never drains a line below its watermark.
+		Within a pass it only moves forward, so K8_DEBUG_PRINT's seq 0 doesn't hold everything back.*/
+		if(r->lastpass != pass){
+			__atomic_store_n(&r->last, seq, __ATOMIC_RELAXED);
+			__atomic_store_n(&r->lastpass, pass, __ATOMIC_RELEASE);
+		} else if(seq > r->last) __atomic_store_n(&r->last, seq, __ATOMIC_RELEASE);
+		k8_log_format(r->recs + (h & (K8_LOG_RING - 1)), out, pass, seq, tag, fmt, ap);
+		__atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+	} else {
+		k8_log_rec rec;
+		k8_log_format(&rec, out, pass, seq, tag, fmt, ap);
+		pthread_mutex_lock(&k8_log_lock);
+		k8_log_pend(&rec);
+		pthread_mutex_unlock(&k8_log_lock);
+	}
+	va_end(ap);
+}
+
+#define K8_LOG(seq, ...) k8_log_printf(stdout, (uint64_t)(seq), __func__, __VA_ARGS__)
+#define K8_LOG_PASS() k8_log_pass();
+
+#else
+#define K8_LOG(seq, ...) do{K_IO printf(__VA_ARGS__); K_END_IO}while(0)
+#define K8_LOG_PASS() /*a comment*/
+static inline void k8_log_flush(){}
+#endif
+
+/*
+Parallel backends.
+By default the parallel multiplexers are OpenMP loops- PRAGMA_PARALLEL in front of a for loop.
+Define K8_BACKEND_POOL (and link with -pthread) to run PARALLEL and SUPARA multiplexers on a persistent
+work stealing pool instead. The pool's threads stay around (spinning for a while, then sleeping)
+between calls, so back to back multiplexers and multiplexers called in a loop don't pay to fork and join.
+
+The iterations are cut into chunks of K8_POOL_GRAIN (or k8_pool_set_grain), and every thread starts
+out with an even, contiguous share of them- the same share a static OpenMP schedule would give it.
+A thread which runs out steals half of what another thread has left.
+K8_POOL_THREADS (compile time, or the environment variable) sets the number of threads, the caller included.
+k8_pool_set_threads(n) runs jobs on only the first n of them from then on, 0 going back to all.
+A multiplexer called while the pool is busy (from inside a kernel, or from another thread) just runs serially.
+
+Only the multiplexers written with K8_PARFOR use the pool; other PRAGMA_PARALLEL loops stay OpenMP.
+K8_PARFOR_RANGEFN(name, argtype, first, step, body...) generates the function the pool calls for a chunk,
+with body seeing the argument as a and the iteration as i = first + k*step.
+K8_PARFOR(alias, name, arg, count) goes right before the for loop, which is what runs without the pool.
+K8_PARREGION(alias) and K8_PARREGION_FOR(alias, name, arg, count) are the same for a block holding several
+loops in a row, like PRAGMA_REGION_* and PRAGMA_FOR_*. Everything in the block outside of those loops has to
+be fine to run on every thread.
+*/
+//A piece of a parallel loop, iterations lo to hi.
+typedef void (*k8_rangefn)(void* arg, size_t lo, size_t hi);
+
+//For spin loops.
+#if defined(__x86_64__) || defined(__i386__)
+#define k8_cpu_relax() __builtin_ia32_pause()
+#else
+#define k8_cpu_relax() /*a comment*/
+#endif
+
+#ifdef K8_BACKEND_POOL
+#include <pthread.h>
+#include <unistd.h>
+
+#ifndef K8_POOL_GRAIN
+#define K8_POOL_GRAIN 1024
+#endif
+#ifndef K8_POOL_MAX_THREADS
+#define K8_POOL_MAX_THREADS 256
+#endif
+//How many times an idle thread checks for work before going to sleep.
+#ifndef K8_POOL_SPIN
+#define K8_POOL_SPIN (1<<16)
+#endif
+
+//The chunks one thread has left, [low 32 bits, high 32 bits). The owner takes from the bottom, thieves from the top.
+typedef struct{
+	uint64_t range;
+	char pad[64 - sizeof(uint64_t)];
+} k8_pool_deque;
+
+static struct{
+	pthread_once_t once;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int nthreads;
+	int limit;			/*Threads a job is dealt out to, at most nthreads. k8_pool_set_threads.*/
+	size_t grain;
+	uint32_t busy;		/*Somebody is running a job.*/
+	uint32_t open;		/*Workers may join the current job.*/
+	uint32_t active;	/*Workers inside the current job.*/
+	uint64_t generation;/*Bumped for every job.*/
+	k8_rangefn fn;
+	void* arg;
+	size_t count;
+	size_t chunk;
+	uint64_t remaining;	/*Chunks not yet finished.*/
+	k8_pool_deque deques[K8_POOL_MAX_THREADS];
+	int nteams;
+	int team[K8_POOL_MAX_THREADS];	/*The NUMA node each thread works for.*/
+} k8_pool = {PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static inline uint64_t k8_pool_pack(uint32_t lo, uint32_t hi){return ((uint64_t)hi << 32) | lo;}
+
+static inline int k8_pool_pop(k8_pool_deque* d, uint32_t* chunk){
+	uint64_t r = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+	for(;;){
+		const uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+		if(lo >= hi) return 0;
+		if(__atomic_compare_exchange_n(&d->range, &r, k8_pool_pack(lo + 1, hi), 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{*chunk = lo; return 1;}
+	}
+}
+
+//Take the top half of the fullest deque, from a thread of the same team if any of them have chunks left,
+//so chunks stay on the NUMA node that owns their part of the state. Returns zero once every chunk has been claimed.
+static inline int k8_pool_steal(int self){
+	for(;;){
+		int victim = -1, near = -1;
+		uint32_t most = 0, mostnear = 0;
+		uint64_t r = 0, rnear = 0;
+		for(int t = 0; t < k8_pool.nthreads; t++){
+			const uint64_t v = __atomic_load_n(&k8_pool.deques[t].range, __ATOMIC_ACQUIRE);
+			const uint32_t lo = (uint32_t)v, hi = (uint32_t)(v >> 32);
+			if(t == self || hi <= lo) continue;
+			if(hi - lo > most) {most = hi - lo; victim = t; r = v;}
+			if(k8_pool.team[t] == k8_pool.team[self] && hi - lo > mostnear) {mostnear = hi - lo; near = t; rnear = v;}
+		}
+		if(near >= 0) {victim = near; r = rnear;}
+		if(victim < 0) return 0;
+		const uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+		const uint32_t split = hi - (hi - lo + 1) / 2;
+		if(__atomic_compare_exchange_n(&k8_pool.deques[victim].range, &r, k8_pool_pack(lo, split), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			/*Nobody steals from an empty deque, so ours can just be overwritten.*/
+			__atomic_store_n(&k8_pool.deques[self].range, k8_pool_pack(split, hi), __ATOMIC_RELEASE);
+			return 1;
+		}
+	}
+}
+
+static inline void k8_pool_work(int self){
+	uint32_t c;
+	do{
+		while(k8_pool_pop(k8_pool.deques + self, &c)){
+			const size_t lo = (size_t)c * k8_pool.chunk;
+			const size_t hi = lo + k8_pool.chunk < k8_pool.count ? lo + k8_pool.chunk : k8_pool.count;
+			k8_pool.fn(k8_pool.arg, lo, hi);
+			__atomic_fetch_sub(&k8_pool.remaining, 1, __ATOMIC_RELEASE);
+		}
+	}while(k8_pool_steal(self));
+}
+
+static void* k8_pool_worker(void* p){
+	const int self = (int)(intptr_t)p;
+	uint64_t seen = 0;
+	for(;;){
+		uint64_t gen;
+		for(int spins = 0; (gen = __atomic_load_n(&k8_pool.generation, __ATOMIC_ACQUIRE)) == seen && spins < K8_POOL_SPIN; spins++)
+			k8_cpu_relax();
+		if(gen == seen){
+			pthread_mutex_lock(&k8_pool.lock);
+			while((gen = __atomic_load_n(&k8_pool.generation, __ATOMIC_ACQUIRE)) == seen)
+				pthread_cond_wait(&k8_pool.wake, &k8_pool.lock);
+			pthread_mutex_unlock(&k8_pool.lock);
+		}
+		seen = gen;
+		/*The job may already be over. The caller waits for active to drop to zero before it reuses anything.*/
+		__atomic_fetch_add(&k8_pool.active, 1, __ATOMIC_SEQ_CST);
+		/*Threads past k8_pool_set_threads' limit sit the job out, stealing included.*/
+		if(__atomic_load_n(&k8_pool.open, __ATOMIC_SEQ_CST)){
+			const int limit = __atomic_load_n(&k8_pool.limit, __ATOMIC_RELAXED);
+			if(!limit || self < limit) k8_pool_work(self);
+		}
+		__atomic_fetch_sub(&k8_pool.active, 1, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+#if defined(__linux__) && defined(CPU_SET)
+static void k8_pool_cpus(void* set, unsigned lo, unsigned hi){
+	for(unsigned c = lo; c <= hi && c < CPU_SETSIZE; c++) CPU_SET(c, (cpu_set_t*)set);
+}
+#endif
+
+/*
+Threads are split into teams of neighbours, one team per NUMA node, and a job's chunks are dealt out in order,
+so each team gets a contiguous part of the state. With _GNU_SOURCE defined (for CPU_SET) every worker is pinned
+to the CPUs of its team's node. The calling thread is team 0 and is left where it is.
+*/
+static void k8_pool_start(){
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+#ifdef K8_POOL_THREADS
+	n = K8_POOL_THREADS;
+#endif
+	const char* env = getenv("K8_POOL_THREADS");
+	if(env && atoi(env) > 0) n = atoi(env);
+	if(n < 1) n = 1;
+	if(n > K8_POOL_MAX_THREADS) n = K8_POOL_MAX_THREADS;
+	k8_pool.grain = K8_POOL_GRAIN;
+	k8_pool.nteams = k8_numa_nodes() < n ? k8_numa_nodes() : (int)n;
+	k8_pool.nthreads = 1;
+	for(long t = 1; t < n; t++){
+		pthread_t th;
+		pthread_attr_t attr;
+		k8_pool.team[t] = (int)(t * k8_pool.nteams / n);
+		pthread_attr_init(&attr);
+#if defined(__linux__) && defined(CPU_SET)
+		if(k8_pool.nteams > 1){
+			char path[64];
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", k8_pool.team[t]);
+			if(k8_read_ranges(path, k8_pool_cpus, &set)) pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+		}
+#endif
+		const int failed = pthread_create(&th, &attr, k8_pool_worker, (void*)(intptr_t)t);
+		pthread_attr_destroy(&attr);
+		if(failed) break;
+		pthread_detach(th);
+		k8_pool.nthreads++;
+	}
+}
+
+//The threads jobs run on, the caller included.
+static inline int k8_pool_threads(){
+	pthread_once(&k8_pool.once, k8_pool_start);
+	const int limit = __atomic_load_n(&k8_pool.limit, __ATOMIC_RELAXED);
+	return limit ? limit : k8_pool.nthreads;
+}
+//The threads the pool has.
+static inline int k8_pool_size(){
+	pthread_once(&k8_pool.once, k8_pool_start);
+	return k8_pool.nthreads;
+}
+//Run jobs on the first n threads only (0 for all of them), the rest stay idle. Returns how many it will use.
+//Like k8_pool_set_grain, call it between multiplexers, not during one.
+static inline int k8_pool_set_threads(int n){
+	pthread_once(&k8_pool.once, k8_pool_start);
+	if(n <= 0 || n > k8_pool.nthreads) n = k8_pool.nthreads;
+	__atomic_store_n(&k8_pool.limit, n, __ATOMIC_RELAXED);
+	return n;
+}
+static inline void k8_pool_set_grain(size_t grain){
+	pthread_once(&k8_pool.once, k8_pool_start);
+	k8_pool.grain = grain ? grain : 1;
+}
+
+//Run fn over [0, count) on the pool, in chunks of grain iterations.
+static inline void k8_pool_for_grain(k8_rangefn fn, void* arg, size_t count, size_t grain){
+	uint32_t idle = 0;
+	pthread_once(&k8_pool.once, k8_pool_start);
+	if(!grain) grain = 1;
+	const int n = k8_pool_threads();
+	if(n < 2 || count <= grain ||
+		!__atomic_compare_exchange_n(&k8_pool.busy, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{fn(arg, 0, count); return;}
+	size_t chunk = grain;
+	if(count / chunk >= 0xFFFFFFFFull) chunk = count / 0xFFFFFFFEull + 1; /*Chunk indices have to fit in 32 bits.*/
+	const uint64_t nchunks = (count + chunk - 1) / chunk;
+	k8_pool.fn = fn; k8_pool.arg = arg; k8_pool.count = count; k8_pool.chunk = chunk;
+	__atomic_store_n(&k8_pool.remaining, nchunks, __ATOMIC_RELAXED);
+	for(int t = 0; t < n; t++)
+		__atomic_store_n(&k8_pool.deques[t].range, k8_pool_pack(nchunks * t / n, nchunks * (t + 1) / n), __ATOMIC_RELAXED);
+	for(int t = n; t < k8_pool.nthreads; t++)
+		__atomic_store_n(&k8_pool.deques[t].range, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&k8_pool.open, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&k8_pool.lock);
+	__atomic_fetch_add(&k8_pool.generation, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&k8_pool.wake);
+	pthread_mutex_unlock(&k8_pool.lock);
+	k8_pool_work(0);
+	while(__atomic_load_n(&k8_pool.remaining, __ATOMIC_ACQUIRE))
+		k8_cpu_relax();
+	__atomic_store_n(&k8_pool.open, 0, __ATOMIC_SEQ_CST);
+	while(__atomic_load_n(&k8_pool.active, __ATOMIC_SEQ_CST))
+		k8_cpu_relax();
+	__atomic_store_n(&k8_pool.busy, 0, __ATOMIC_RELEASE);
+}
+
+//Run fn over [0, count) on the pool, in chunks of K8_POOL_GRAIN (or k8_pool_set_grain) iterations.
+static inline void k8_pool_for(k8_rangefn fn, void* arg, size_t count){
+	pthread_once(&k8_pool.once, k8_pool_start);
+	k8_pool_for_grain(fn, arg, count, k8_pool.grain);
+}
+
+#define K8_PARFOR_RANGEFN(name, argtype, first, step, ...)\
+static inline void name##_k8range(void* k8arg, size_t k8lo, size_t k8hi){\
+	argtype a = k8arg;\
+	for(size_t k8k = k8lo; k8k < k8hi; k8k++){\
+		const size_t i = (first) + k8k * (step);\
+		__VA_ARGS__\
+	}\
+}
+#define K8_PARFOR(alias, name, arg, count) K8_LOG_PASS() K8_PARFOR_##alias(name, arg, count)
+#define K8_PARFOR_PARALLEL(name, arg, count) k8_pool_for(name##_k8range, (void*)(arg), count); if(0)
+#define K8_PARFOR_SUPARA(name, arg, count) k8_pool_for(name##_k8range, (void*)(arg), count); if(0)
+#define K8_PARFOR_SIMD(name, arg, count) PRAGMA_SIMD
+#define K8_PARFOR_NOPARALLEL(name, arg, count) /*a comment*/
+//The pool has no regions- the caller runs the code between the loops alone, and each loop is its own job.
+//One iteration per chunk, these loops are short and their iterations are big.
+#define K8_PARREGION(alias) K8_LOG_PASS()
+#define K8_PARREGION_FOR(alias, name, arg, count) K8_PARREGION_FOR_##alias(name, arg, count)
+#define K8_PARREGION_FOR_PARALLEL(name, arg, count) k8_pool_for_grain(name##_k8range, (void*)(arg), count, 1); if(0)
+#define K8_PARREGION_FOR_SUPARA(name, arg, count) k8_pool_for_grain(name##_k8range, (void*)(arg), count, 1); if(0)
+#define K8_PARREGION_FOR_SIMD(name, arg, count) /*a comment*/
+#define K8_PARREGION_FOR_NOPARALLEL(name, arg, count) /*a comment*/
+#elif defined(K8_SUPARA_HOST_TEAMS)
+//SUPARA loops go through k8_supara_for, so they get range functions. The rest are plain pragmas.
+#define K8_PARFOR_RANGEFN(name, argtype, first, step, ...)\
+static inline void name##_k8range(void* k8arg, size_t k8lo, size_t k8hi){\
+	argtype a = k8arg;\
+	for(size_t k8k = k8lo; k8k < k8hi; k8k++){\
+		const size_t i = (first) + k8k * (step);\
+		__VA_ARGS__\
+	}\
+}
+#define K8_PARFOR(alias, name, arg, count) K8_LOG_PASS() K8_PARFOR_##alias(name, arg, count)
+#define K8_PARFOR_PARALLEL(name, arg, count) PRAGMA_PARALLEL
+#define K8_PARFOR_SUPARA(name, arg, count) k8_supara_for(name##_k8range, (void*)(arg), count); if(0)
+#define K8_PARFOR_SIMD(name, arg, count) PRAGMA_SIMD
+#define K8_PARFOR_NOPARALLEL(name, arg, count) /*a comment*/
+#define K8_PARREGION(alias) K8_LOG_PASS() PRAGMA_REGION_##alias
+#define K8_PARREGION_FOR(alias, name, arg, count) PRAGMA_FOR_##alias
+
+//A SUPARA loop: host teams at the top level, where they're allowed, and a parallel for inside of another
+//parallel region. Each thread gets one contiguous piece, like the static schedules of the pragmas.
+static inline void k8_supara_for(k8_rangefn fn, void* arg, size_t count){
+	size_t pieces = (size_t)k8_supara_teams() * (size_t)k8_supara_team_threads();
+	if(pieces > count) pieces = count;
+	if(omp_get_level() == 0){
+		PRAGMA_SUPARA
+		for(size_t t = 0; t < pieces; t++)
+			fn(arg, count * t / pieces, count * (t + 1) / pieces);
+	} else {
+		PRAGMA_PARALLEL
+		for(size_t t = 0; t < pieces; t++)
+			fn(arg, count * t / pieces, count * (t + 1) / pieces);
+	}
+}
+#else
+#define K8_PARFOR_RANGEFN(name, argtype, first, step, ...) /*a comment*/
+#define K8_PARFOR(alias, name, arg, count) K8_LOG_PASS() PRAGMA_##alias
+#define K8_PARREGION(alias) K8_LOG_PASS() PRAGMA_REGION_##alias
+#define K8_PARREGION_FOR(alias, name, arg, count) PRAGMA_FOR_##alias
+#endif
+
+//Whether an alias runs on more than one thread.
+#define K8_ALIAS_THREADED(alias) K8_ALIAS_THREADED_##alias
+#define K8_ALIAS_THREADED_PARALLEL 1
+#define K8_ALIAS_THREADED_SUPARA 1
+#define K8_ALIAS_THREADED_SIMD 0
+#define K8_ALIAS_THREADED_NOPARALLEL 0
+
+//How many threads k8_parallel_tasks would use.
+static inline int k8_parallel_threads(){
+#ifdef K8_BACKEND_POOL
+	return k8_pool_threads();
+#else
+	return k8_max_threads();
+#endif
+}
+
+#ifdef K8_LOG_BUFFERED
+//Whether this thread is outside of every parallel loop.
+static inline int k8_log_toplevel(){
+#ifdef K8_BACKEND_POOL
+	if(__atomic_load_n(&k8_pool.busy, __ATOMIC_ACQUIRE)) return 0;
+#endif
+#if defined(_OPENMP)
+	return omp_get_level() == 0;
+#else
+	return 1;
+#endif
+}
+//A parallel loop is starting, what it logs is a new pass. Loops nested in it are part of its pass.
+static inline void k8_log_pass(){
+	if(!k8_log_toplevel()) return;
+	__atomic_store_n(&k8_log_team, k8_parallel_threads(), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&k8_log_passes, 1, __ATOMIC_RELEASE);
+}
+#endif
+
+//Run fn over [0, count) one iteration at a time, on whichever backend is in use if threaded is set.
+//For code which is written once rather than generated per alias. Iterations should be big.
+static inline void k8_parallel_tasks(k8_rangefn fn, void* arg, size_t count, int threaded){
+	if(!threaded || count < 2) {fn(arg, 0, count); return;}
+	K8_LOG_PASS()
+#ifdef K8_BACKEND_POOL
+	k8_pool_for_grain(fn, arg, count, 1);
+#else
+	PRAGMA_REGION_PARALLEL
+	{
+		PRAGMA_FOR_PARALLEL
+		for(size_t t = 0; t < count; t++)
+			fn(arg, t, t + 1);
+	}
+#endif
+}
+
+/*
+Task graph.
+Kernels have no hidden state, so which calls can run at the same time is decided entirely by what they read and write.
+Add calls to a k8_graph, each with the bytes it reads and the bytes it writes, and k8_graph_run runs them-
+a call waits only for the earlier calls it conflicts with (it reads what they write, or writes what they read or write),
+and everything else runs side by side, on every thread.
+	k8_graph_init(&g)
+	k8_graph_add(&g, fn, arg, rd, rbytes, wr, wbytes)	fn(arg) reads rbytes at rd and writes wbytes at wr. Returns the node's number.
+	k8_graph_add_inplace(&g, fn, arg, bytes)			fn(arg) reads and writes bytes at arg- a multiplexer on a state.
+	k8_graph_run(&g, threaded)							Run it all, in parallel if threaded. Can be run again.
+	k8_graph_free(&g)
+K8_GRAPH_TASK(name, nm) makes name##_task, which calls the state##nm multiplexer name on arg.
+So "X over state30.state20s[3..7]" is five nodes, k8_graph_add_inplace(&g, X_task, big->state20s + i, STATE_SIZE(20)).
+The nodes run inside a parallel region, so their own multiplexers run serially- the parallelism is between nodes.
+*/
+typedef void (*k8_taskfn)(void* arg);
+#define K8_GRAPH_TASK(name, nm) static void name##_task(void* p){name((state##nm*)p);}
+
+typedef struct{
+	k8_taskfn fn;
+	void* arg;
+	const char *rd, *wr;
+	size_t rbytes, wbytes;
+	uint32_t ndeps;		/*Earlier nodes this one waits for.*/
+	uint32_t waiting;	/*Of those, not finished yet. Counts down during a run.*/
+	uint32_t nsucc, capsucc;
+	uint32_t* succ;		/*Later nodes waiting for this one.*/
+} k8_graph_node;
+
+typedef struct{
+	k8_graph_node* nodes;
+	uint32_t n, cap;
+	uint32_t* ready;	/*node + 1, in the order they became ready. 0 is not there yet.*/
+	uint32_t head, tail;
+} k8_graph;
+
+static inline void k8_graph_init(k8_graph* g){
+	memset(g, 0, sizeof(*g));
+}
+static inline void k8_graph_free(k8_graph* g){
+	for(uint32_t i = 0; i < g->n; i++) free(g->nodes[i].succ);
+	free(g->nodes);
+	free(g->ready);
+	k8_graph_init(g);
+}
+
+static inline int k8_graph_overlap(const char* a, size_t na, const char* b, size_t nb){
+	return na && nb && a < b + nb && b < a + na;
+}
+
+static inline uint32_t k8_graph_add(k8_graph* g, k8_taskfn fn, void* arg, const void* rd, size_t rbytes, const void* wr, size_t wbytes){
+	if(g->n == g->cap){
+		g->cap = g->cap ? 2 * g->cap : 64;
+		g->nodes = realloc(g->nodes, g->cap * sizeof(k8_graph_node));
+		if(!g->nodes) {fputs("k8_graph: out of memory.\n", stderr); abort();}
+	}
+	const uint32_t id = g->n++;
+	k8_graph_node* x = g->nodes + id;
+	memset(x, 0, sizeof(*x));
+	x->fn = fn; x->arg = arg;
+	x->rd = rd; x->rbytes = rbytes;
+	x->wr = wr; x->wbytes = wbytes;
+	for(uint32_t p = 0; p < id; p++){
+		k8_graph_node* y = g->nodes + p;
+		if(!k8_graph_overlap(y->wr, y->wbytes, x->rd, x->rbytes) &&
+			!k8_graph_overlap(y->wr, y->wbytes, x->wr, x->wbytes) &&
+			!k8_graph_overlap(y->rd, y->rbytes, x->wr, x->wbytes)) continue;
+		if(y->nsucc == y->capsucc){
+			y->capsucc = y->capsucc ? 2 * y->capsucc : 4;
+			y->succ = realloc(y->succ, y->capsucc * sizeof(uint32_t));
+			if(!y->succ) {fputs("k8_graph: out of memory.\n", stderr); abort();}
+		}
+		y->succ[y->nsucc++] = id;
+		x->ndeps++;
+	}
+	return id;
+}
+
+static inline uint32_t k8_graph_add_inplace(k8_graph* g, k8_taskfn fn, void* arg, size_t bytes){
+	return k8_graph_add(g, fn, arg, arg, bytes, arg, bytes);
+}
+
+static inline void k8_graph_push(k8_graph* g, uint32_t id){
+	const uint32_t at = __atomic_fetch_add(&g->tail, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(g->ready + at, id + 1, __ATOMIC_RELEASE);
+}
+
+//How many times an idle graph worker checks for a ready node before it starts yielding, and then sleeping.
+#ifndef K8_GRAPH_SPIN
+#define K8_GRAPH_SPIN (1<<10)
+#endif
+
+//Waiting on the node somebody else is running: spin a little, then give the CPU away so the node gets it
+//on a crowded machine, then nap for 50 microseconds at a time.
+static inline void k8_graph_backoff(uint32_t* spins){
+	const struct timespec t = {0, 50000};
+	if(++*spins < K8_GRAPH_SPIN) k8_cpu_relax();
+#if defined(__unix__) || defined(__APPLE__)
+	else if(*spins < 2 * K8_GRAPH_SPIN) sched_yield();
+	else nanosleep(&t, NULL);
+#endif
+}
+
+//Take ready nodes until every node has been taken. Each of the threads runs one of these.
+static inline void k8_graph_worker(void* arg, size_t lo, size_t hi){
+	k8_graph* g = arg;
+	uint32_t spins = 0;
+	(void)lo; (void)hi;
+	for(;;){
+		uint32_t at = __atomic_load_n(&g->head, __ATOMIC_ACQUIRE), id;
+		if(at >= g->n) return;
+		/*Somebody is still running the node this one waits for.*/
+		if(!(id = __atomic_load_n(g->ready + at, __ATOMIC_ACQUIRE))) {k8_graph_backoff(&spins); continue;}
+		if(!__atomic_compare_exchange_n(&g->head, &at, at + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+		spins = 0;
+		k8_graph_node* x = g->nodes + id - 1;
+		x->fn(x->arg);
+		for(uint32_t s = 0; s < x->nsucc; s++)
+			if(__atomic_sub_fetch(&g->nodes[x->succ[s]].waiting, 1, __ATOMIC_ACQ_REL) == 0)
+				k8_graph_push(g, x->succ[s]);
+	}
+}
+
+static inline void k8_graph_run(k8_graph* g, int threaded){
+	if(!g->n) return;
+	free(g->ready);
+	g->ready = calloc(g->n, sizeof(uint32_t));
+	if(!g->ready) {fputs("k8_graph: out of memory.\n", stderr); abort();}
+	g->head = g->tail = 0;
+	for(uint32_t i = 0; i < g->n; i++){
+		g->nodes[i].waiting = g->nodes[i].ndeps;
+		if(!g->nodes[i].ndeps) k8_graph_push(g, i);
+	}
+	size_t workers = threaded ? (size_t)k8_parallel_threads() : 1;
+	if(workers > g->n) workers = g->n;
+	k8_parallel_tasks(k8_graph_worker, g, workers, threaded);
+}
+
+/*
+IO ports (README item 16).
+A port is a range of bytes in a state which is ordinary in every way, except that writing to it with
+K8_PORT_STORE or k8_port_write hands the bytes written to an IO function- on every write, no polling.
+	k8_port_open(at, bytes, fn, arg)	Make the bytes at at a port. fn(arg, offset, data, len) gets every write to it,
+										offset being from at. Returns the port's number, or -1 past K8_PORTS_MAX ports.
+	k8_port_close(id)					Waits for the port's writes to be handled first.
+	K8_PORT_STORE(lvalue, value)		lvalue = value, plus the IO if lvalue is in a port. For use in kernels.
+	k8_port_write(dst, src, len)		memcpy, plus the IO if any of dst is in a port.
+	k8_port_sync()						Wait until every write so far has been handled.
+Open and close ports between multiplexer calls, never while kernels are running.
+Only writes to the state itself count, so the kernel has to be handed its element in place- a plain
+K8_MULTIPLEX, not a multiplexer which hands kernels a copy to work on (INDEXED, SHARED_STATE...).
+In threaded builds (OpenMP or K8_BACKEND_POOL) a write is queued on one lock free ring of K8_PORT_RING events,
+which any number of threads push to, and an IO thread calls the IO functions in the order the writes were queued.
+Kernels only wait if the ring is full. Writes bigger than K8_PORT_EVENT bytes are queued in pieces.
+Without threads there's no ring and no IO thread- K8_PORT_STORE calls the IO function directly.
+Either way only one IO function runs at a time, so they need no locks of their own.
+IO functions must not write to ports themselves.
+*/
+typedef void (*k8_portfn)(void* arg, size_t offset, const void* data, size_t len);
+
+typedef struct{
+	char *lo, *hi;
+	k8_portfn fn;
+	void* arg;
+} k8_port;
+
+#ifndef K8_PORTS_MAX
+#define K8_PORTS_MAX 16
+#endif
+static k8_port k8_ports[K8_PORTS_MAX];
+static int k8_nports = 0; /*One past the highest port ever opened.*/
+
+#if defined(_OPENMP) || defined(K8_BACKEND_POOL)
+#include <pthread.h>
+
+//Events in the ring. A power of 2.
+#ifndef K8_PORT_RING
+#define K8_PORT_RING 4096
+#endif
+#ifndef K8_PORT_EVENT
+#define K8_PORT_EVENT 48
+#endif
+
+typedef struct{
+	size_t seq;	/*Which lap of the ring the event is on, and whether it's filled. Vyukov's bounded queue.*/
+	int port;
+	uint32_t len;
+	size_t offset;
+	char data[K8_PORT_EVENT];
+} k8_port_event;
+
+static k8_port_event k8_port_ring[K8_PORT_RING];
+static struct{
+	size_t head;	/*Next event to claim. Pushed by every writer.*/
+	char pad0[64 - sizeof(size_t)];
+	size_t done;	/*Events handled. Only the IO thread writes it.*/
+	char pad1[64 - sizeof(size_t)];
+} k8_port_q;
+static int k8_port_running = 0;
+static pthread_t k8_port_thread;
+static pthread_once_t k8_port_once = PTHREAD_ONCE_INIT;
+
+static void k8_port_nap(){
+	const struct timespec t = {0, 50000};
+	nanosleep(&t, NULL);
+}
+
+static void* k8_port_io(void* unused){
+	K8_UNUSED(unused);
+	size_t tail = 0;
+	for(;;){
+		k8_port_event* e = k8_port_ring + (tail & (K8_PORT_RING - 1));
+		if(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) == tail + 1){
+			const k8_port* p = k8_ports + e->port;
+			p->fn(p->arg, e->offset, e->data, e->len);
+			__atomic_store_n(&e->seq, tail + K8_PORT_RING, __ATOMIC_RELEASE);
+			__atomic_store_n(&k8_port_q.done, ++tail, __ATOMIC_RELEASE);
+			continue;
+		}
+		if(!__atomic_load_n(&k8_port_running, __ATOMIC_ACQUIRE) && tail == __atomic_load_n(&k8_port_q.head, __ATOMIC_ACQUIRE)) break;
+		k8_port_nap();
+	}
+	return NULL;
+}
+
+static void k8_port_sync(){
+	const size_t target = __atomic_load_n(&k8_port_q.head, __ATOMIC_ACQUIRE);
+	while(__atomic_load_n(&k8_port_q.done, __ATOMIC_ACQUIRE) < target) k8_port_nap();
+}
+
+static void k8_port_exit(){
+	__atomic_store_n(&k8_port_running, 0, __ATOMIC_RELEASE);
+	pthread_join(k8_port_thread, NULL);
+}
+
+static void k8_port_start(){
+	for(size_t i = 0; i < K8_PORT_RING; i++) k8_port_ring[i].seq = i;
+	__atomic_store_n(&k8_port_running, 1, __ATOMIC_RELEASE);
+	if(pthread_create(&k8_port_thread, NULL, k8_port_io, NULL)) {fputs("k8_port: can't start the IO thread.\n", stderr); abort();}
+	atexit(k8_port_exit);
+}
+
+static void k8_port_push(int port, size_t offset, const char* data, size_t len){
+	pthread_once(&k8_port_once, k8_port_start);
+	for(; len; ){
+		const size_t piece = len < K8_PORT_EVENT ? len : K8_PORT_EVENT;
+		size_t pos = __atomic_load_n(&k8_port_q.head, __ATOMIC_RELAXED);
+		k8_port_event* e;
+		for(;;){
+			e = k8_port_ring + (pos & (K8_PORT_RING - 1));
+			const size_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+			if(seq == pos){
+				if(__atomic_compare_exchange_n(&k8_port_q.head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+			} else if(seq < pos){
+				/*Full. The IO thread is a whole lap behind.*/
+				k8_cpu_relax();
+				pos = __atomic_load_n(&k8_port_q.head, __ATOMIC_RELAXED);
+			} else pos = __atomic_load_n(&k8_port_q.head, __ATOMIC_RELAXED);
+		}
+		e->port = port;
+		e->offset = offset;
+		e->len = (uint32_t)piece;
+		memcpy(e->data, data, piece);
+		__atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+		offset += piece; data += piece; len -= piece;
+	}
+}
+#else
+static inline void k8_port_sync(){}
+static inline void k8_port_push(int port, size_t offset, const char* data, size_t len){
+	k8_ports[port].fn(k8_ports[port].arg, offset, data, len);
+}
+#endif
+
+static inline int k8_port_open(void* at, size_t bytes, k8_portfn fn, void* arg){
+	for(int i = 0; i < K8_PORTS_MAX; i++)
+		if(!k8_ports[i].fn){
+			k8_ports[i].lo = at;
+			k8_ports[i].hi = (char*)at + bytes;
+			k8_ports[i].arg = arg;
+			k8_ports[i].fn = fn;
+			if(i >= k8_nports) k8_nports = i + 1;
+			return i;
+		}
+	return -1;
+}
+static inline void k8_port_close(int id){
+	k8_port_sync();
+	memset(k8_ports + id, 0, sizeof(k8_port));
+}
+
+//The IO for len bytes just written at at.
+static inline void k8_port_touch(const void* at, size_t len){
+	const char* lo = at;
+	const char* hi = lo + len;
+	for(int i = 0; i < k8_nports; i++){
+		const k8_port* p = k8_ports + i;
+		if(!p->fn || hi <= p->lo || lo >= p->hi) continue;
+		const char* from = lo > p->lo ? lo : p->lo;
+		const char* to = hi < p->hi ? hi : p->hi;
+		k8_port_push(i, (size_t)(from - p->lo), from, (size_t)(to - from));
+	}
+}
+static inline void k8_port_write(void* dst, const void* src, size_t len){
+	memcpy(dst, src, len);
+	k8_port_touch(dst, len);
+}
+#define K8_PORT_STORE(lvalue, value) do{(lvalue) = (value); k8_port_touch(&(lvalue), sizeof(lvalue));}while(0)
+
 #ifndef __STDC_IEC_559__
 #warning "Nonconformant float implementation, floating point may not work correctly. Run floatmath tests."
 #endif
@@ -975,26 +2170,319 @@ static inline void k_endian_cond_byteswap##n (state##n *a){\
 		k_byteswap##n(a);\
 }
 
-//Define functions which need to know nn and nm.
-#define KNLCONV(nn, nm)\
-/*Retrieve the highest precision bits*/\
-static inline state##nm statemix##nn(state##nn a, state##nn b){\
-	state##nm ret;\
-	k_at(ret, 0, nn, nm) = a;\
-	k_at(ret, 1, nn, nm) = b;\
-	return ret;\
-}\
-static inline void statemixp##nn(state##nn *a, state##nn *b, state##nm *ret){\
-	k_pat(ret, 0, nn, nm) = *a;\
-	k_pat(ret, 1, nn, nm) = *b;\
-}\
-/*Duplicate */\
-static inline state##nm statedup##nn(state##nn a){\
-	return statemix##nn(a,a);\
-}\
-static inline state##nn state_high##nm(state##nm a){\
-	return k_at(a, 0, nn, nm);\
-}\
+/*
+Mapped states.
+A state can live in a file instead of RAM. The file is mapped, not read, so a pass over a state35 on disk
+only faults in what it touches, and the OS can page it back out.
+	k8_map_file(path, bytes, flags)		Map bytes of a file. NULL on failure.
+	k8_map_anon(bytes)					Map zeroed anonymous memory. NULL on failure.
+	k8_unmap(p, bytes)					Unmap either. Shared file mappings are written back by the OS.
+	k8_map_sync(p, bytes)				Write a shared file mapping back now.
+	k8_map_state(path, n, flags)		k8_map_file, typed as a state##n*.
+	state##nm##_map(path, flags), state##nm##_unmap(p)	The same, as functions, for every state from state2 up.
+Flags:
+	K8_MAP_READ		Read only. Writing to the state will crash. This is the default.
+	K8_MAP_WRITE	Writes go back to the file.
+	K8_MAP_PRIVATE	Writes stay in memory (copy on write), the file is not changed.
+	K8_MAP_CREATE	Create the file if needed, and extend it (sparsely) to the size of the state.
+					The file is opened for writing to do that, the mapping is still read only without WRITE or PRIVATE.
+	K8_MAP_POPULATE	Fault everything in up front, where the OS supports it.
+Without K8_MAP_CREATE, a file shorter than the state is refused rather than mapped,
+since touching past its end would kill the program.
+
+Define K8_ADVISE and multiplexers hint the OS about how they are about to walk a state (K8_ADVISE_RANGE):
+most are sequential, shufflers write their scratch at random and NLOGN passes want the whole state resident.
+Only states of at least K8_ADVISE_MIN bytes are hinted, the test is done at compile time.
+It is off by default: the extra call in every multiplexer makes GCC's interprocedural constant propagation
+crawl on files with many big states (kernel8.c takes four times as long to build).
+k8_advise(p, bytes, K8_ADV_DONTNEED) after a pass over a mapped file lets the OS drop those pages.
+Only pages wholly inside the range are dropped. Dropped pages of a private or anonymous mapping read back
+as zeroes (or as the file's contents), so only use it on bytes you are done with.
+*/
+#define K8_MAP_READ 0
+#define K8_MAP_WRITE 1
+#define K8_MAP_PRIVATE 2
+#define K8_MAP_CREATE 4
+#define K8_MAP_POPULATE 8
+
+#ifndef K8_ADVISE_MIN
+#define K8_ADVISE_MIN ((size_t)1<<21)
+#endif
+
+//The states mapped here, so that code which would free() a state can tell it mustn't (k8_scratch_swap).
+//Past K8_MAPPED_MAX live mappings the rest aren't remembered.
+#ifndef K8_MAPPED_MAX
+#define K8_MAPPED_MAX 256
+#endif
+static void* k8_mapped_slots[K8_MAPPED_MAX];
+
+static inline int k8_mapped(const void* p){
+	for(int i = 0; p && i < K8_MAPPED_MAX; i++)
+		if(__atomic_load_n(k8_mapped_slots + i, __ATOMIC_ACQUIRE) == p) return 1;
+	return 0;
+}
+static inline void* k8_mapped_add(void* p){
+	if(!p || k8_mapped(p)) return p;
+	for(int i = 0; i < K8_MAPPED_MAX; i++){
+		void* empty = NULL;
+		if(__atomic_compare_exchange_n(k8_mapped_slots + i, &empty, p, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+	}
+	return p;
+}
+static inline void k8_mapped_remove(void* p){
+	for(int i = 0; p && i < K8_MAPPED_MAX; i++){
+		void* mine = p;
+		if(__atomic_compare_exchange_n(k8_mapped_slots + i, &mine, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return;
+	}
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define K8_ADV_NORMAL MADV_NORMAL
+#define K8_ADV_SEQUENTIAL MADV_SEQUENTIAL
+#define K8_ADV_RANDOM MADV_RANDOM
+#define K8_ADV_WILLNEED MADV_WILLNEED
+#define K8_ADV_DONTNEED MADV_DONTNEED
+
+static inline void* k8_map_file(const char* path, size_t bytes, int flags){
+	const int oflags = (flags & (K8_MAP_WRITE | K8_MAP_CREATE)) ? O_RDWR | ((flags & K8_MAP_CREATE) ? O_CREAT : 0) : O_RDONLY;
+	const int fd = open(path, oflags, 0644);
+	struct stat st;
+	if(fd < 0) return NULL;
+	if(fstat(fd, &st) || ((size_t)st.st_size < bytes && (!(flags & K8_MAP_CREATE) || ftruncate(fd, bytes))))
+		{close(fd); return NULL;}
+	int mflags = (flags & K8_MAP_PRIVATE) ? MAP_PRIVATE : MAP_SHARED;
+#ifdef MAP_POPULATE
+	if(flags & K8_MAP_POPULATE) mflags |= MAP_POPULATE;
+#endif
+	void* p = mmap(NULL, bytes, PROT_READ | ((flags & (K8_MAP_WRITE | K8_MAP_PRIVATE)) ? PROT_WRITE : 0), mflags, fd, 0);
+	close(fd); /*The mapping keeps the file open.*/
+	return p == MAP_FAILED ? NULL : k8_mapped_add(p);
+}
+static inline void* k8_map_anon(size_t bytes){
+	void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : k8_mapped_add(p);
+}
+static inline void k8_unmap(void* p, size_t bytes){
+	k8_mapped_remove(p);
+	if(p) munmap(p, bytes);
+}
+static inline int k8_map_sync(void* p, size_t bytes){
+	return msync(p, bytes, MS_SYNC);
+}
+//madvise wants whole pages. Hints are only hints, so they are rounded out to the surrounding pages,
+//but DONTNEED throws away what's in the pages, so it is rounded in- bytes outside the range are never lost.
+static inline void k8_advise(const void* p, size_t bytes, int advice){
+	static size_t pagesize = 0;
+	if(!pagesize) pagesize = sysconf(_SC_PAGESIZE);
+	const uintptr_t mask = ~(uintptr_t)(pagesize - 1);
+	uintptr_t lo = (uintptr_t)p & mask;
+	uintptr_t hi = ((uintptr_t)p + bytes + pagesize - 1) & mask;
+	if(advice == K8_ADV_DONTNEED){
+		lo = ((uintptr_t)p + pagesize - 1) & mask;
+		hi = ((uintptr_t)p + bytes) & mask;
+		if(hi <= lo) return;
+	}
+	madvise((void*)lo, hi - lo, advice);
+}
+#else
+#define K8_ADV_NORMAL 0
+#define K8_ADV_SEQUENTIAL 0
+#define K8_ADV_RANDOM 0
+#define K8_ADV_WILLNEED 0
+#define K8_ADV_DONTNEED 0
+static inline void* k8_map_file(const char* path, size_t bytes, int flags){return NULL;}
+static inline void* k8_map_anon(size_t bytes){return calloc(1, bytes);}
+static inline void k8_unmap(void* p, size_t bytes){free(p);}
+static inline int k8_map_sync(void* p, size_t bytes){return 0;}
+static inline void k8_advise(const void* p, size_t bytes, int advice){}
+#endif
+
+#define k8_map_state(path, n, flags) ((state##n*)k8_map_file(path, STATE_SIZE(n), flags))
+
+/*
+Allocating big states.
+malloc and globals leave every page to be faulted in by whichever thread touches it first, which is
+usually the one filling it in, so the whole state ends up on one NUMA node. k8_alloc_state maps the state
+itself, with huge pages if it can get them, and can fault it in from every thread at once, each thread
+touching one contiguous slice- slice t on thread t, as the pool deals out a job and as a static PRAGMA_PARALLEL loop does.
+	k8_alloc_state(n, policy)				A zeroed state##n*, NULL on failure.
+	k8_free_state(p, n)						Free it. The size has to be the one it was allocated with.
+	k8_realloc_state(p, n, nnew, policy)	Move it to a state##nnew, keeping what fits. The copy doubles as first touch.
+And k8_alloc_bytes, k8_free_bytes, k8_realloc_bytes for sizes which aren't states.
+Policies can be combined:
+	K8_ALLOC_TOUCH		Fault the state in from every thread.
+	K8_ALLOC_THP		Ask for transparent huge pages.
+	K8_ALLOC_HUGE_2M	Use 2 MiB huge pages, falling back to K8_ALLOC_THP.
+	K8_ALLOC_HUGE_1G	Use 1 GiB huge pages, falling back to K8_ALLOC_HUGE_2M.
+	K8_ALLOC_DEFAULT	The biggest pages available, and first touch.
+Huge pages (hugetlbfs) have to be reserved by the administrator beforehand, and are only used for states
+which are a whole number of them. Everything else ends up as normal pages.
+*/
+#define K8_ALLOC_PLAIN 0
+#define K8_ALLOC_TOUCH 1
+#define K8_ALLOC_THP 2
+#define K8_ALLOC_HUGE_2M 4
+#define K8_ALLOC_HUGE_1G 8
+#define K8_ALLOC_DEFAULT (K8_ALLOC_HUGE_1G | K8_ALLOC_TOUCH)
+
+#define K8_HUGE_2M ((size_t)1<<21)
+#define K8_HUGE_1G ((size_t)1<<30)
+
+//Copy keep bytes from p to q and touch one byte of every other stride bytes of q, one slice per thread.
+typedef struct{
+	BYTE* q;
+	const BYTE* p;
+	size_t bytes, keep, stride, per;
+	int touch;
+} k8_touch_job;
+
+static void k8_touch_slices(void* arg, size_t lo, size_t hi){
+	const k8_touch_job* j = arg;
+	const size_t n = (j->bytes + j->stride - 1) / j->stride;
+	for(size_t t = lo; t < hi; t++)
+		for(size_t i = t * j->per; i < (t + 1) * j->per && i < n; i++){
+			const size_t at = i * j->stride;
+			if(at < j->keep)
+				memcpy(j->q + at, j->p + at, j->keep - at < j->stride ? j->keep - at : j->stride);
+			else if(j->touch)
+				((volatile BYTE*)j->q)[at] = 0;
+		}
+}
+
+static inline void k8_touch_split(k8_touch_job* j){
+	const size_t n = (j->bytes + j->stride - 1) / j->stride;
+	size_t slices = (size_t)k8_parallel_threads();
+	if(slices > n) slices = n;
+	if(!slices) return;
+	j->per = (n + slices - 1) / slices;
+#ifdef K8_BACKEND_POOL
+	k8_parallel_tasks(k8_touch_slices, j, slices, 1);
+#else
+	/*Statically, like the multiplexers' PRAGMA_PARALLEL loops: slice t on thread t.*/
+	PRAGMA_PARALLEL
+	for(size_t t = 0; t < slices; t++)
+		k8_touch_slices(j, t, t + 1);
+#endif
+}
+
+//Touch one byte every stride bytes, each thread its own slice.
+static inline void k8_first_touch(void* p, size_t bytes, size_t stride){
+	k8_touch_job j = {p, NULL, bytes, 0, stride, 0, 1};
+	k8_touch_split(&j);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#ifdef __linux__
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+static inline void* k8_alloc_huge(size_t bytes, size_t pagesize, int sizeflag){
+#ifdef MAP_HUGETLB
+	if(bytes % pagesize) return NULL;
+	void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeflag, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+#else
+	return NULL;
+#endif
+}
+
+//Transparent huge pages only line up with 2 MiB boundaries, so map extra and trim it down.
+static inline void* k8_alloc_thp(size_t bytes){
+	if(bytes < K8_HUGE_2M) return k8_map_anon(bytes);
+	BYTE* raw = mmap(NULL, bytes + K8_HUGE_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(raw == MAP_FAILED) return NULL;
+	BYTE* p = (BYTE*)(((uintptr_t)raw + K8_HUGE_2M - 1) & ~(uintptr_t)(K8_HUGE_2M - 1));
+	if(p > raw) munmap(raw, p - raw);
+	if(raw + K8_HUGE_2M > p) munmap(p + bytes, raw + K8_HUGE_2M - p);
+#ifdef MADV_HUGEPAGE
+	madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+static inline void* k8_alloc_bytes(size_t bytes, int policy){
+	void* p = NULL;
+	size_t stride = 4096;
+#ifdef MAP_HUGETLB
+	if(!p && (policy & K8_ALLOC_HUGE_1G) && (p = k8_alloc_huge(bytes, K8_HUGE_1G, MAP_HUGE_1GB))) stride = K8_HUGE_1G;
+	if(!p && (policy & (K8_ALLOC_HUGE_1G | K8_ALLOC_HUGE_2M)) && (p = k8_alloc_huge(bytes, K8_HUGE_2M, MAP_HUGE_2MB))) stride = K8_HUGE_2M;
+#endif
+	if(!p && (policy & (K8_ALLOC_HUGE_1G | K8_ALLOC_HUGE_2M | K8_ALLOC_THP))) p = k8_alloc_thp(bytes);
+	if(!p) p = k8_map_anon(bytes);
+	k8_mapped_add(p);
+	if(p && (policy & K8_ALLOC_TOUCH)) k8_first_touch(p, bytes, stride);
+	return p;
+}
+static inline void k8_free_bytes(void* p, size_t bytes){
+	k8_unmap(p, bytes);
+}
+#else
+static inline void* k8_alloc_bytes(size_t bytes, int policy){
+	void* p = calloc(1, bytes);
+	if(p && (policy & K8_ALLOC_TOUCH)) k8_first_touch(p, bytes, 4096);
+	return p;
+}
+static inline void k8_free_bytes(void* p, size_t bytes){
+	free(p);
+}
+#endif
+
+//The copy is the first touch- each thread copies the part it will work on later.
+static inline void* k8_realloc_bytes(void* p, size_t bytes, size_t newbytes, int policy){
+	BYTE* q = k8_alloc_bytes(newbytes, policy & ~K8_ALLOC_TOUCH);
+	const size_t keep = !p ? 0 : bytes < newbytes ? bytes : newbytes;
+	const size_t chunk = 4096;
+	if(!q) return NULL;
+	k8_touch_job j = {q, p, newbytes, keep, chunk, 0, (policy & K8_ALLOC_TOUCH) != 0};
+	if(!p && !j.touch) return q;
+	k8_touch_split(&j);
+	if(p) k8_free_bytes(p, bytes);
+	return q;
+}
+
+#define k8_alloc_state(n, policy) ((state##n*)k8_alloc_bytes(STATE_SIZE(n), policy))
+#define k8_free_state(p, n) k8_free_bytes(p, STATE_SIZE(n))
+#define k8_realloc_state(p, n, nnew, policy) ((state##nnew*)k8_realloc_bytes(p, STATE_SIZE(n), STATE_SIZE(nnew), policy))
+
+#ifdef K8_ADVISE
+#define K8_ADVISE_RANGE(p, bytes, advice) if((size_t)(bytes) >= K8_ADVISE_MIN) k8_advise(p, bytes, advice);
+#else
+#define K8_ADVISE_RANGE(p, bytes, advice) /*a comment*/
+#endif
+
+//Define functions which need to know nn and nm.
+#define KNLCONV(nn, nm)\
+/*Retrieve the highest precision bits*/\
+static inline state##nm statemix##nn(state##nn a, state##nn b){\
+	state##nm ret;\
+	k_at(ret, 0, nn, nm) = a;\
+	k_at(ret, 1, nn, nm) = b;\
+	return ret;\
+}\
+static inline void statemixp##nn(state##nn *a, state##nn *b, state##nm *ret){\
+	k_pat(ret, 0, nn, nm) = *a;\
+	k_pat(ret, 1, nn, nm) = *b;\
+}\
+/*Duplicate */\
+static inline state##nm statedup##nn(state##nn a){\
+	return statemix##nn(a,a);\
+}\
+static inline state##nn state_high##nm(state##nm a){\
+	return k_at(a, 0, nn, nm);\
+}\
 static inline void state_highp##nm(state##nm *a, state##nn *ret){\
 	*ret = k_pat(a, 0, nn, nm);\
 }\
@@ -1088,7 +2576,13 @@ static inline void state##nm##_from_string(char* str, state##nm *q){\
 	memcpy(q->state, str, len);\
 	q->state[STATE_SIZE(nm) - 1] = '\0';\
 }\
-/*Take in a string, read this many bytes from a file. Binary and text versions.*/\
+/*Map a file as a state, zero copy. See k8_map_file.*/\
+static inline state##nm* state##nm##_map(const char* path, int flags){\
+	return k8_map_file(path, STATE_SIZE(nm), flags);\
+}\
+static inline void state##nm##_unmap(state##nm* p){\
+	k8_unmap(p, STATE_SIZE(nm));\
+}\
 
 //Iterate over an entire container calling a kernel.
 #define K8_FOREACH(func, arr, nn, nm)\
@@ -1184,13 +2678,17 @@ static inline void name(state##n *c){\
 //These macros ALWAYS produce pointer kernels, they produce better bytecode.
 
 #define K8_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_MULTIPLEX_CALLP(iscopy, func, nn))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)) );\
-	PRAGMA_##alias\
+	K8_PARFOR(alias, name, a, (end)-(start))\
 	for(size_t i = start; i < end; i++)\
 		K8_MULTIPLEX_CALLP(iscopy, func, nn);\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
 }
 
 #define K8_MULTIPLEX_PARTIAL(name, func, nn, nm, start, end, iscopy)\
@@ -1226,17 +2724,11 @@ K8_MULTIPLEX_PARTIAL_SUPARA(name, func, nn, nm, 0, (size_t)(STATE_SIZE(nm)/STATE
 
 //Multiplex a low level kernel to a higher level, with index in the upper half.
 //Your kernel must operate on statennn but the input array will be treated as statenn's
-#define K8_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
-static inline void name(state##nm *a){\
-	state##nn current, index; \
-	state##nnn current_indexed;\
-	K8_STATIC_ASSERT(start >= 0);\
-	K8_STATIC_ASSERT(start <= end);\
-	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)) );\
-	K8_STATIC_ASSERT(nnn == (nn + 1));\
-	PRAGMA_##alias\
-	for(ssize_t i = start; i < end; i++)\
+//The body of the indexed multiplexer, for element i.
+#define K8_MULTIPLEX_INDEXED_BODY(func, nn, nnn, iscopy)\
 	{\
+		state##nn current, index; \
+		state##nnn current_indexed;\
 		uint32_t ind32 = i; uint16_t ind16 = i; uint8_t ind8 = i;\
 		current = a->state##nn##s[i];\
 		if(nn == 1)/*Single byte indices.*/\
@@ -1254,7 +2746,21 @@ static inline void name(state##nm *a){\
 		/*Run the function on the indexed thing and return the low */\
 		current = current_indexed.state##nn##s[1];\
 		memcpy(a->state + i*((ssize_t)1<<(nn-1)), current.state, ((ssize_t)1<<(nn-1)) );\
-	}\
+	}
+
+#define K8_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_MULTIPLEX_INDEXED_BODY(func, nn, nnn, iscopy))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)) );\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(ssize_t i = start; i < end; i++)\
+		K8_MULTIPLEX_INDEXED_BODY(func, nn, nnn, iscopy)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
 }
 
 #define K8_MULTIPLEX_INDEXED_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
@@ -1287,69 +2793,376 @@ static inline void name(state##nm *a){\
 
 
 
+/*
+Scratch space.
+Shufflers and emplacers need a whole second state to build their result in. That used to live on the stack,
+which is fine for state10 and a segfault for state24. Instead every thread keeps one reusable buffer
+per state size, allocated the first time it is needed.
+	k8_scratch(n)			This thread's state##n sized buffer.
+	k8_scratch_swap(n, &p)	Trade p for this thread's buffer. p must have come from malloc- a state from k8_alloc_state,
+							k8_map_file or k8_map_anon isn't traded, the buffer is copied into it instead.
+							(Stack and static states can't be told apart from malloc'd ones. Don't.)
+	k8_scratch_release()	Free all of this thread's buffers, for example before the thread exits.
+*/
+#define K8_SCRATCH_CLASSES 64
+static K8_THREAD_LOCAL void* k8_scratch_slots[K8_SCRATCH_CLASSES];
+
+static inline void* k8_scratch(int n){
+	if(!k8_scratch_slots[n]){
+		k8_scratch_slots[n] = malloc(STATE_SIZE(n));
+		if(!k8_scratch_slots[n]) {fputs("k8_scratch: out of memory.\n", stderr); abort();}
+	}
+	return k8_scratch_slots[n];
+}
+static inline void k8_scratch_swap(int n, void** p){
+	void* t = k8_scratch(n);
+	if(k8_mapped(*p)) {memcpy(*p, t, STATE_SIZE(n)); return;}
+	k8_scratch_slots[n] = *p;
+	*p = t;
+}
+static K8_THREAD_LOCAL void* k8_scatter_buf;
+static K8_THREAD_LOCAL size_t k8_scatter_cap;
+static K8_THREAD_LOCAL void* k8_scatter_vbuf;
+static K8_THREAD_LOCAL size_t k8_scatter_vcap;
+static inline void k8_scratch_release(){
+	for(int n = 0; n < K8_SCRATCH_CLASSES; n++){
+		free(k8_scratch_slots[n]);
+		k8_scratch_slots[n] = NULL;
+	}
+	free(k8_scatter_buf);
+	k8_scatter_buf = NULL;
+	k8_scatter_cap = 0;
+	free(k8_scatter_vbuf);
+	k8_scatter_vbuf = NULL;
+	k8_scatter_vcap = 0;
+}
+
+/*
+Scatter engine.
+Writes src element k to ret element dest[k], for a whole batch of k's, and where several k's have the same
+destination the last one wins- exactly what the serial loop does, just not serially.
+The destinations are radix partitioned into buckets by their top bits, each bucket covering about K8_SCATTER_SPAN bytes
+of ret. Counting and partitioning go over contiguous chunks of k's in parallel, and the partition is stable,
+so every bucket holds its k's in order. Then the buckets are written in parallel- every random store
+lands in a small window of ret, instead of all over it.
+	k8_scatter_reserve(n, es)	This thread's dest array for a batch of up to n (at most K8_SCATTER_SEGMENT) elements of es bytes.
+	k8_scatter_values(n, es)	Somewhere to put the batch's elements, if they aren't in a state already.
+	k8_scatter(ret, src, es, retn, n, threaded)	Scatter the batch. es is the element size, retn the number of elements in ret.
+*/
+//Bytes of ret per bucket. Small enough to stay in L2 while a bucket is written.
+#ifndef K8_SCATTER_SPAN
+#define K8_SCATTER_SPAN (1<<20)
+#endif
+#ifndef K8_SCATTER_MAX_BUCKETS
+#define K8_SCATTER_MAX_BUCKETS 1024
+#endif
+#ifndef K8_SCATTER_CHUNKS
+#define K8_SCATTER_CHUNKS 64
+#endif
+//Elements per chunk, at the least.
+#ifndef K8_SCATTER_MIN_CHUNK
+#define K8_SCATTER_MIN_CHUNK 4096
+#endif
+//Elements per batch. The batch's buffers take 8 bytes an element, plus a copy of it.
+//The fewer elements a batch has compared to ret, the fewer of them land on the same cache line of a bucket.
+#ifndef K8_SCATTER_SEGMENT
+#define K8_SCATTER_SEGMENT (1<<24)
+#endif
+
+//The batch is partitioned into records of a destination and a copy of the element,
+//so that writing a bucket reads its records in order rather than gathering from src.
+typedef struct{
+	char* ret;
+	const char* src;
+	size_t es, rs, n, chunks, buckets;
+	int shift;
+	const uint32_t* dest;
+	char* recs;
+	uint32_t* counts;	/*chunks x buckets. Counts, then write positions.*/
+	uint32_t* bstart;	/*buckets + 1*/
+} k8_scatter_job;
+
+static inline uint32_t* k8_scatter_reserve(size_t n, size_t es){
+	const size_t need = n * (2*sizeof(uint32_t) + es) +
+		(K8_SCATTER_CHUNKS * K8_SCATTER_MAX_BUCKETS + K8_SCATTER_MAX_BUCKETS + 1) * sizeof(uint32_t);
+	if(need > k8_scatter_cap){
+		free(k8_scatter_buf);
+		k8_scatter_buf = malloc(need);
+		if(!k8_scatter_buf) {fputs("k8_scatter: out of memory.\n", stderr); abort();}
+		k8_scatter_cap = need;
+	}
+	return k8_scatter_buf;
+}
+
+//A second buffer, for batches whose elements are computed rather than read from a state (emplacers).
+static inline void* k8_scatter_values(size_t n, size_t es){
+	if(n * es > k8_scatter_vcap){
+		free(k8_scatter_vbuf);
+		k8_scatter_vbuf = malloc(n * es);
+		if(!k8_scatter_vbuf) {fputs("k8_scatter: out of memory.\n", stderr); abort();}
+		k8_scatter_vcap = n * es;
+	}
+	return k8_scatter_vbuf;
+}
+
+typedef struct{
+	char* dst;
+	const char* src;
+	size_t bytes;
+} k8_copy_job;
+#define K8_COPY_CHUNK (1<<20)
+static inline void k8_parallel_copy_range(void* arg, size_t lo, size_t hi){
+	const k8_copy_job* j = arg;
+	for(size_t c = lo; c < hi; c++){
+		const size_t at = c * K8_COPY_CHUNK;
+		memcpy(j->dst + at, j->src + at, j->bytes - at < K8_COPY_CHUNK ? j->bytes - at : K8_COPY_CHUNK);
+	}
+}
+//memcpy, in K8_COPY_CHUNK pieces on k8_parallel_tasks.
+static inline void k8_parallel_copy(void* dst, const void* src, size_t bytes, int threaded){
+	k8_copy_job j = {dst, src, bytes};
+	k8_parallel_tasks(k8_parallel_copy_range, &j, (bytes + K8_COPY_CHUNK - 1) / K8_COPY_CHUNK, threaded);
+}
+
+//Runs of the same bucket are common (a shuffle of neighbours to neighbours), so the current bucket's
+//count or position is kept in a register rather than incremented in memory for every element.
+static inline void k8_scatter_count(void* arg, size_t lo, size_t hi){
+	const k8_scatter_job* j = arg;
+	for(size_t c = lo; c < hi; c++){
+		uint32_t* cnt = j->counts + c * j->buckets;
+		const size_t k1 = j->n * (c + 1) / j->chunks;
+		uint32_t last = 0, run = 0;
+		for(size_t k = j->n * c / j->chunks; k < k1; k++){
+			const uint32_t b = j->dest[k] >> j->shift;
+			if(b == last) run++;
+			else {cnt[last] += run; last = b; run = 1;}
+		}
+		cnt[last] += run;
+	}
+}
+static inline void k8_scatter_partition(void* arg, size_t lo, size_t hi){
+	const k8_scatter_job* j = arg;
+	for(size_t c = lo; c < hi; c++){
+		uint32_t* pos = j->counts + c * j->buckets;
+		const size_t k1 = j->n * (c + 1) / j->chunks;
+		uint32_t last = 0, at = pos[0];
+		for(size_t k = j->n * c / j->chunks; k < k1; k++){
+			const uint32_t b = j->dest[k] >> j->shift;
+			if(b != last) {pos[last] = at; last = b; at = pos[b];}
+			char* r = j->recs + (size_t)at++ * j->rs;
+			memcpy(r, j->dest + k, sizeof(uint32_t));
+			memcpy(r + sizeof(uint32_t), j->src + k * j->es, j->es);
+		}
+		pos[last] = at;
+	}
+}
+#define K8_SCATTER_WRITE_SIZED(size)\
+	case size: for(; r < e; r += sizeof(uint32_t) + (size)){\
+		uint32_t to; memcpy(&to, r, sizeof(uint32_t));\
+		memcpy(j->ret + (size_t)to * (size), r + sizeof(uint32_t), (size));\
+	} break;
+static inline void k8_scatter_write(void* arg, size_t lo, size_t hi){
+	const k8_scatter_job* j = arg;
+	for(size_t b = lo; b < hi; b++){
+		const char* r = j->recs + (size_t)j->bstart[b] * j->rs;
+		const char* const e = j->recs + (size_t)j->bstart[b + 1] * j->rs;
+		switch(j->es){
+			K8_SCATTER_WRITE_SIZED(1)
+			K8_SCATTER_WRITE_SIZED(2)
+			K8_SCATTER_WRITE_SIZED(4)
+			K8_SCATTER_WRITE_SIZED(8)
+			default: for(; r < e; r += j->rs){
+				uint32_t to; memcpy(&to, r, sizeof(uint32_t));
+				memcpy(j->ret + (size_t)to * j->es, r + sizeof(uint32_t), j->es);
+			}
+		}
+	}
+}
+
+static inline void k8_scatter(void* ret, const void* src, size_t es, size_t retn, size_t n, int threaded){
+	k8_scatter_job j;
+	j.ret = ret; j.src = src; j.es = es; j.rs = sizeof(uint32_t) + es; j.n = n;
+	j.dest = k8_scatter_buf;
+	j.recs = (char*)k8_scatter_buf + n * sizeof(uint32_t);
+	j.shift = 0;
+	while(((size_t)1 << j.shift) * es < K8_SCATTER_SPAN) j.shift++;
+	while(((retn - 1) >> j.shift) + 1 > K8_SCATTER_MAX_BUCKETS) j.shift++;
+	/*Enough buckets to go around, if they can stay a page or more.*/
+	while(threaded && j.shift > 0 && ((retn - 1) >> j.shift) + 1 < 4 * (size_t)k8_parallel_threads() &&
+		((size_t)1 << (j.shift - 1)) * es >= 4096) j.shift--;
+	j.buckets = ((retn - 1) >> j.shift) + 1;
+	if(j.buckets < 2 || n < K8_SCATTER_MIN_CHUNK){
+		/*ret is small enough to stay in cache anyway.*/
+		for(size_t k = 0; k < n; k++)
+			memcpy(j.ret + (size_t)j.dest[k] * es, j.src + k * es, es);
+		return;
+	}
+	/*A couple of chunks a thread, for balance. More only makes the counts bigger.*/
+	j.chunks = threaded ? 2 * (size_t)k8_parallel_threads() : 1;
+	if(j.chunks > K8_SCATTER_CHUNKS) j.chunks = K8_SCATTER_CHUNKS;
+	if(j.chunks > n / K8_SCATTER_MIN_CHUNK) j.chunks = n / K8_SCATTER_MIN_CHUNK;
+	j.counts = (uint32_t*)(j.recs + n * j.rs);
+	j.bstart = j.counts + j.chunks * j.buckets;
+	memset(j.counts, 0, j.chunks * j.buckets * sizeof(uint32_t));
+	k8_parallel_tasks(k8_scatter_count, &j, j.chunks, threaded);
+	uint32_t total = 0;
+	for(size_t b = 0; b < j.buckets; b++){
+		j.bstart[b] = total;
+		for(size_t c = 0; c < j.chunks; c++){
+			const uint32_t cnt = j.counts[c * j.buckets + b];
+			j.counts[c * j.buckets + b] = total;
+			total += cnt;
+		}
+	}
+	j.bstart[j.buckets] = total;
+	k8_parallel_tasks(k8_scatter_partition, &j, j.chunks, threaded);
+	k8_parallel_tasks(k8_scatter_write, &j, j.buckets, threaded);
+}
+
+/*
+Every shuffler and emplacer comes in three kinds-
+	name(state##nm* a)						In place. The result is built in scratch and copied back.
+	name##_to(const state##nm* a, state##nm* ret)	The result goes in ret, which the caller supplies. No copy.
+											If a and ret overlap it works like the in place kind, copy and all.
+	name##_swap(state##nm** a)				The result is built in scratch, then *a and the scratch buffer
+											trade places. No copy, but *a must have come from malloc.
+											A mapped state (k8_alloc_state, k8_map_file) gets the result copied in.
+*/
+#define K8_SCRATCH_SIG_INPLACE(nm) state##nm* a
+#define K8_SCRATCH_SIG_TO(nm) const state##nm* a, state##nm* ret
+#define K8_SCRATCH_SIG_SWAP(nm) state##nm** ap
+
+#define K8_SCRATCH_BEGIN_INPLACE(nm) state##nm* ret = k8_scratch(nm);
+#define K8_SCRATCH_BEGIN_TO(nm) state##nm* const k8to = (const BYTE*)a < (const BYTE*)ret + STATE_SIZE(nm) &&\
+	(const BYTE*)ret < (const BYTE*)a + STATE_SIZE(nm) ? ret : NULL; if(k8to) ret = k8_scratch(nm);
+#define K8_SCRATCH_BEGIN_SWAP(nm) const state##nm* a = *ap; state##nm* ret = k8_scratch(nm);
+
+#define K8_SCRATCH_END_INPLACE(nm) memcpy(a, ret, sizeof(state##nm));
+#define K8_SCRATCH_END_TO(nm) if(k8to) memcpy(k8to, ret, sizeof(state##nm));
+#define K8_SCRATCH_END_SWAP(nm) k8_scratch_swap(nm, (void**)ap);
+
+//Bytes the in place kind copies back.
+#define K8_SCRATCH_COPY_INPLACE(nm) STATE_SIZE(nm)
+#define K8_SCRATCH_COPY_TO(nm) 0
+#define K8_SCRATCH_COPY_SWAP(nm) 0
+
+#define K8_SCRATCH_NAME_INPLACE(name) name
+#define K8_SCRATCH_NAME_TO(name) name##_to
+#define K8_SCRATCH_NAME_SWAP(name) name##_swap
+
 #define K8_SHUFFLE_CALL(func, iscopy) K8_SHUFFLE_CALL_##iscopy (func)
 #define K8_SHUFFLE_CALL_1(func) index = func(index);
 #define K8_SHUFFLE_CALL_0(func) func(&index);
 
-#define K8_SHUFFLE_IND32_PARTIAL(name, func, nn, nm, start, end, iscopy)\
-static inline void name(state##nm* a){\
-	state##nm ret;\
-	state3 index; \
+/*
+Element i goes to wherever func sends the index i, in a state##ni.
+Where nothing lands, the result is unspecified.
+*/
+#define K8_SHUFFLE_KIND(name, func, ni, nn, nm, start, end, iscopy, kind)\
+static inline void K8_SCRATCH_NAME_##kind(name)(K8_SCRATCH_SIG_##kind(nm)){\
+	K8_PROFILE_BEGIN(K8_SCRATCH_NAME_##kind(name))\
+	K8_SCRATCH_BEGIN_##kind(nm)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_ADVISE_RANGE(ret, STATE_SIZE(nm), K8_ADV_RANDOM)\
+	state##ni index; \
 	const size_t emplacemask = (STATE_SIZE(nm)/STATE_SIZE(nn)) - 1;\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
 	loop(i, end-start){\
 		i+= start;\
-		index=to_state3(i);\
+		index=to_state##ni(i);\
 		K8_SHUFFLE_CALL(func, iscopy);\
-		ret.state##nn##s[from_state3(index) & emplacemask] = \
+		ret->state##nn##s[from_state##ni(index) & emplacemask] = \
 		a->state##nn##s[i];\
 	}\
-	*a = ret;\
+	K8_SCRATCH_END_##kind(nm)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn) + K8_SCRATCH_COPY_##kind(nm), (end-start)*STATE_SIZE(nn) + K8_SCRATCH_COPY_##kind(nm))\
 }
 
-#define K8_SHUFFLE_IND32(name, func, nn, nm, iscopy)\
-K8_SHUFFLE_IND32_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_SHUFFLE_PARTIAL(name, func, ni, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_KIND(name, func, ni, nn, nm, start, end, iscopy, INPLACE)\
+K8_SHUFFLE_KIND(name, func, ni, nn, nm, start, end, iscopy, TO)\
+K8_SHUFFLE_KIND(name, func, ni, nn, nm, start, end, iscopy, SWAP)
 
-#define K8_SHUFFLE_IND16_PARTIAL(name, func, nn, nm, start, end, iscopy)\
-static inline void name(state##nm* a){\
-	state##nm ret;\
-	state2 index; \
-	const size_t emplacemask = (STATE_SIZE(nm)/STATE_SIZE(nn)) - 1;\
+/*
+Shufflers on the scatter engine, with a parallelism alias.
+The destinations are computed for a batch of elements at a time (in parallel), then the batch is scattered.
+Same result as the serial shufflers- where several elements land on the same spot, the last one wins.
+*/
+typedef struct{
+	uint32_t* dest;
+	size_t first;
+} k8_shuffle_pass;
+
+#define K8_SHUFFLE_DEST_BODY(func, ni, nn, nm, p, k, iscopy)\
+{\
+	state##ni index = to_state##ni((p)->first + (k));\
+	K8_SHUFFLE_CALL(func, iscopy);\
+	(p)->dest[k] = from_state##ni(index) & ((STATE_SIZE(nm)/STATE_SIZE(nn)) - 1);\
+}
+
+#define K8_SHUFFLE_ALIAS_KIND(name, func, ni, nn, nm, start, end, iscopy, kind, alias)\
+static inline void K8_SCRATCH_NAME_##kind(name)(K8_SCRATCH_SIG_##kind(nm)){\
+	K8_PROFILE_BEGIN(K8_SCRATCH_NAME_##kind(name))\
+	K8_SCRATCH_BEGIN_##kind(nm)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
-	loop(i, end-start){\
-		i+= start;\
-		index=to_state2(i);\
-		K8_SHUFFLE_CALL(func, iscopy);\
-		ret.state##nn##s[from_state3(index) & emplacemask] = \
-		a->state##nn##s[i];\
+	k8_shuffle_pass k8p;\
+	for(size_t k8k0 = (start); k8k0 < (size_t)(end); k8k0 += K8_SCATTER_SEGMENT){\
+		const size_t k8n = (size_t)(end) - k8k0 < K8_SCATTER_SEGMENT ? (size_t)(end) - k8k0 : K8_SCATTER_SEGMENT;\
+		k8p.dest = k8_scatter_reserve(k8n, STATE_SIZE(nn));\
+		k8p.first = k8k0;\
+		K8_PARFOR(alias, name##_dest, &k8p, k8n)\
+		for(size_t i = 0; i < k8n; i++)\
+			K8_SHUFFLE_DEST_BODY(func, ni, nn, nm, (&k8p), i, iscopy)\
+		k8_scatter(ret->state, a->state + k8k0 * STATE_SIZE(nn), STATE_SIZE(nn), STATE_SIZE(nm)/STATE_SIZE(nn), k8n, K8_ALIAS_THREADED(alias));\
 	}\
-	*a = ret;\
+	K8_SCRATCH_END_##kind(nm)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn) + K8_SCRATCH_COPY_##kind(nm), (end-start)*STATE_SIZE(nn) + K8_SCRATCH_COPY_##kind(nm))\
 }
 
+#define K8_SHUFFLE_PARTIAL_ALIAS(name, func, ni, nn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name##_dest, k8_shuffle_pass*, 0, 1, K8_SHUFFLE_DEST_BODY(func, ni, nn, nm, a, i, iscopy))\
+K8_SHUFFLE_ALIAS_KIND(name, func, ni, nn, nm, start, end, iscopy, INPLACE, alias)\
+K8_SHUFFLE_ALIAS_KIND(name, func, ni, nn, nm, start, end, iscopy, TO, alias)\
+K8_SHUFFLE_ALIAS_KIND(name, func, ni, nn, nm, start, end, iscopy, SWAP, alias)
+
+#define K8_SHUFFLE_IND32_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, alias)\
+K8_SHUFFLE_PARTIAL_ALIAS(name, func, 3, nn, nm, start, end, iscopy, alias)
+#define K8_SHUFFLE_IND16_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, alias)\
+K8_SHUFFLE_PARTIAL_ALIAS(name, func, 2, nn, nm, start, end, iscopy, alias)
+#define K8_SHUFFLE_IND8_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, alias)\
+K8_SHUFFLE_PARTIAL_ALIAS(name, func, 1, nn, nm, start, end, iscopy, alias)
+
+#define K8_SHUFFLE_IND32_PARTIAL_SUPARA(name, func, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_IND32_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, SUPARA)
+#define K8_SHUFFLE_IND32_SUPARA(name, func, nn, nm, iscopy)\
+K8_SHUFFLE_IND32_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_SHUFFLE_IND16_PARTIAL_SUPARA(name, func, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_IND16_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, SUPARA)
+#define K8_SHUFFLE_IND16_SUPARA(name, func, nn, nm, iscopy)\
+K8_SHUFFLE_IND16_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_SHUFFLE_IND8_PARTIAL_SUPARA(name, func, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_IND8_PARTIAL_ALIAS(name, func, nn, nm, start, end, iscopy, SUPARA)
+#define K8_SHUFFLE_IND8_SUPARA(name, func, nn, nm, iscopy)\
+K8_SHUFFLE_IND8_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_SHUFFLE_IND32_PARTIAL(name, func, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_PARTIAL(name, func, 3, nn, nm, start, end, iscopy)
+
+#define K8_SHUFFLE_IND32(name, func, nn, nm, iscopy)\
+K8_SHUFFLE_IND32_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_SHUFFLE_IND16_PARTIAL(name, func, nn, nm, start, end, iscopy)\
+K8_SHUFFLE_PARTIAL(name, func, 2, nn, nm, start, end, iscopy)
+
 #define K8_SHUFFLE_IND16(name, func, nn, nm, iscopy)\
 K8_SHUFFLE_IND16_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
 
 #define K8_SHUFFLE_IND8_PARTIAL(name, func, nn, nm, start, end, iscopy)\
-static inline void name(state##nm* a){\
-	state##nm ret;\
-	state1 index; \
-	const size_t emplacemask = (STATE_SIZE(nm)/STATE_SIZE(nn)) - 1;\
-	K8_STATIC_ASSERT(start >= 0);\
-	K8_STATIC_ASSERT(start <= end);\
-	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
-	loop(i, end-start){\
-		i+= start;\
-		index=to_state1(i);\
-		K8_SHUFFLE_CALL(func, iscopy);\
-		ret.state##nn##s[from_state3(index) & emplacemask] = \
-		a->state##nn##s[i];\
-	}\
-	*a = ret;\
-}
+K8_SHUFFLE_PARTIAL(name, func, 1, nn, nm, start, end, iscopy)
 
 #define K8_SHUFFLE_IND8(name, func, nn, nm, iscopy)\
 K8_SHUFFLE_IND8_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
@@ -1361,13 +3174,17 @@ K8_SHUFFLE_IND8_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)),
 in the upper half.
 
 The index returned in the upper half is used to place in the result.
+Elements nothing is emplaced on keep their old value, so the result starts out as a copy.
 */
-#define K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
-static inline void name(state##nm *a){\
-	state##nm ret;\
+#define K8_MULTIPLEX_INDEXED_EMPLACE_KIND(name, func, nn, nnn, nm, start, end, iscopy, kind)\
+static inline void K8_SCRATCH_NAME_##kind(name)(K8_SCRATCH_SIG_##kind(nm)){\
+	K8_PROFILE_BEGIN(K8_SCRATCH_NAME_##kind(name))\
+	K8_SCRATCH_BEGIN_##kind(nm)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_ADVISE_RANGE(ret, STATE_SIZE(nm), K8_ADV_RANDOM)\
 	state##nn current, index; \
 	state##nnn current_indexed;\
-	memcpy(&ret, a, sizeof(state##nm));\
+	memcpy(ret, a, sizeof(state##nm));\
 	const size_t emplacemask = (STATE_SIZE(nm)/STATE_SIZE(nn)) - 1;\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
@@ -1395,27 +3212,112 @@ static inline void name(state##nm *a){\
 		if(nn == 1){/*Single byte indices.*/\
 			memcpy(&ind8, index.state, 1);\
 			ind8 &= emplacemask;\
-			memcpy(ret.state + ind8*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
+			memcpy(ret->state + ind8*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
 		}else if (nn == 2){/*Two byte indices*/\
 			memcpy(&ind16, index.state, 2);\
 			ind16 &= emplacemask;\
-			memcpy(ret.state + ind16*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
+			memcpy(ret->state + ind16*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
 		}else if (nn == 3){/*Three byte indices*/\
 			memcpy(&ind32, index.state, 4);\
 			ind32 &= emplacemask;\
-			memcpy(ret.state + ind32*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
+			memcpy(ret->state + ind32*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
 		}else{	/*We must copy the 32 bit index into the upper half.*/\
 			memcpy(&ind32, index.state, 4);\
 			ind32 &= emplacemask;\
-			memcpy(ret.state + ind32*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
+			memcpy(ret->state + ind32*STATE_SIZE(nn), current.state, STATE_SIZE(nn) );\
 		}\
 	}\
-	memcpy(a, &ret, sizeof(state##nm));\
+	K8_SCRATCH_END_##kind(nm)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn) + STATE_SIZE(nm) + K8_SCRATCH_COPY_##kind(nm), (end-start)*STATE_SIZE(nn) + STATE_SIZE(nm) + K8_SCRATCH_COPY_##kind(nm))\
 }
 
+#define K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_INDEXED_EMPLACE_KIND(name, func, nn, nnn, nm, start, end, iscopy, INPLACE)\
+K8_MULTIPLEX_INDEXED_EMPLACE_KIND(name, func, nn, nnn, nm, start, end, iscopy, TO)\
+K8_MULTIPLEX_INDEXED_EMPLACE_KIND(name, func, nn, nnn, nm, start, end, iscopy, SWAP)
+
 #define K8_MULTIPLEX_INDEXED_EMPLACE(name, func, nn, nnn, nm, iscopy)\
 K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
 
+/*
+Emplacers on the scatter engine, with a parallelism alias.
+The kernel runs on a batch of elements at a time (in parallel), leaving their destinations and new values behind,
+then the batch is scattered. Same result as the serial emplacers- elements nothing lands on keep their old value,
+and where several elements land on the same spot, the last one wins.
+The index is put in and taken out with one width for the whole loop, K8_INDEX_BYTES(nn).
+Bytes of the index state past those are zero, rather than left over from whatever was there.
+*/
+#define K8_INDEX_BYTES(nn) ((nn) == 1 ? 1 : (nn) == 2 ? 2 : 4)
+static inline void k8_index_put(void* p, int bytes, uint32_t i){
+	const uint8_t i8 = (uint8_t)i;
+	const uint16_t i16 = (uint16_t)i;
+	if(bytes == 1) memcpy(p, &i8, 1);
+	else if(bytes == 2) memcpy(p, &i16, 2);
+	else memcpy(p, &i, 4);
+}
+static inline uint32_t k8_index_get(const void* p, int bytes){
+	uint8_t i8; uint16_t i16; uint32_t i32;
+	if(bytes == 1) {memcpy(&i8, p, 1); return i8;}
+	if(bytes == 2) {memcpy(&i16, p, 2); return i16;}
+	memcpy(&i32, p, 4);
+	return i32;
+}
+
+typedef struct{
+	uint32_t* dest;
+	char* vals;
+	const char* src;
+	size_t first;
+} k8_emplace_pass;
+
+#define K8_EMPLACE_BODY(func, nn, nnn, nm, p, k, iscopy)\
+{\
+	state##nnn current_indexed;\
+	memset(current_indexed.state##nn##s[0].state, 0, STATE_SIZE(nn));\
+	k8_index_put(current_indexed.state##nn##s[0].state, K8_INDEX_BYTES(nn), (uint32_t)((p)->first + (k)));\
+	memcpy(current_indexed.state##nn##s[1].state, (p)->src + ((p)->first + (k)) * STATE_SIZE(nn), STATE_SIZE(nn));\
+	K8_MULTIPLEX_ICALLP(iscopy, func);\
+	(p)->dest[k] = k8_index_get(current_indexed.state##nn##s[0].state, K8_INDEX_BYTES(nn)) & ((STATE_SIZE(nm)/STATE_SIZE(nn)) - 1);\
+	memcpy((p)->vals + (k) * STATE_SIZE(nn), current_indexed.state##nn##s[1].state, STATE_SIZE(nn));\
+}
+
+#define K8_MULTIPLEX_INDEXED_EMPLACE_ALIAS_KIND(name, func, nn, nnn, nm, start, end, iscopy, kind, alias)\
+static inline void K8_SCRATCH_NAME_##kind(name)(K8_SCRATCH_SIG_##kind(nm)){\
+	K8_PROFILE_BEGIN(K8_SCRATCH_NAME_##kind(name))\
+	K8_SCRATCH_BEGIN_##kind(nm)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	k8_parallel_copy(ret, a, sizeof(state##nm), K8_ALIAS_THREADED(alias));\
+	k8_emplace_pass k8p;\
+	k8p.src = (const char*)a->state;\
+	for(size_t k8k0 = (start); k8k0 < (size_t)(end); k8k0 += K8_SCATTER_SEGMENT){\
+		const size_t k8n = (size_t)(end) - k8k0 < K8_SCATTER_SEGMENT ? (size_t)(end) - k8k0 : K8_SCATTER_SEGMENT;\
+		k8p.dest = k8_scatter_reserve(k8n, STATE_SIZE(nn));\
+		k8p.vals = k8_scatter_values(k8n, STATE_SIZE(nn));\
+		k8p.first = k8k0;\
+		K8_PARFOR(alias, name##_emplace, &k8p, k8n)\
+		for(size_t i = 0; i < k8n; i++)\
+			K8_EMPLACE_BODY(func, nn, nnn, nm, (&k8p), i, iscopy)\
+		k8_scatter(ret->state, k8p.vals, STATE_SIZE(nn), STATE_SIZE(nm)/STATE_SIZE(nn), k8n, K8_ALIAS_THREADED(alias));\
+	}\
+	K8_SCRATCH_END_##kind(nm)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn) + STATE_SIZE(nm) + K8_SCRATCH_COPY_##kind(nm), (end-start)*STATE_SIZE(nn) + STATE_SIZE(nm) + K8_SCRATCH_COPY_##kind(nm))\
+}
+
+#define K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name##_emplace, k8_emplace_pass*, 0, 1, K8_EMPLACE_BODY(func, nn, nnn, nm, a, i, iscopy))\
+K8_MULTIPLEX_INDEXED_EMPLACE_ALIAS_KIND(name, func, nn, nnn, nm, start, end, iscopy, INPLACE, alias)\
+K8_MULTIPLEX_INDEXED_EMPLACE_ALIAS_KIND(name, func, nn, nnn, nm, start, end, iscopy, TO, alias)\
+K8_MULTIPLEX_INDEXED_EMPLACE_ALIAS_KIND(name, func, nn, nnn, nm, start, end, iscopy, SWAP, alias)
+
+#define K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, SUPARA)
+
+#define K8_MULTIPLEX_INDEXED_EMPLACE_SUPARA(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL_SUPARA(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
 
 //The shared state function.
 //func must take in nnn of state.
@@ -1437,6 +3339,8 @@ K8_MULTIPLEX_INDEXED_EMPLACE_PARTIAL(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)
 //but only if "doind" is one.
 #define K8_SHARED_STATE_PARTIAL_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
 	state##nnn passed; state##nwind saved;\
 	passed.state##nn##s[0] = a->state##nn##s[sharedind];\
 	K8_STATIC_ASSERT(start >= 0);\
@@ -1462,7 +3366,8 @@ static inline void name(state##nm *a){\
 	if(doind){ /*Write back the useful data.*/\
 		passed.state##nn##s[0].state##nwind##s[whereind] = saved;\
 	}\
-	memcpy(a->state + sharedind, passed.state, sizeof(state##nn));\
+	a->state##nn##s[sharedind] = passed.state##nn##s[0];\
+	K8_PROFILE_END(end-start, (end-start+1)*STATE_SIZE(nn), (end-start+1)*STATE_SIZE(nn))\
 }
 
 //WIND version.
@@ -1475,56 +3380,211 @@ K8_SHARED_STATE_PARTIAL_WIND(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_S
 #define K8_SHARED_STATE(name, func, nn, nnn, nm, iscopy)\
 K8_SHARED_STATE_PARTIAL(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy)
 
-//Variant in which the shared state is "read only"
-
-#define K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, alias)\
+/*
+Pair pointer variants.
+The _PAIR multiplexers (K8_SHARED_STATE_PAIR, K8_RO_SHARED_STATE_PAIR, K8_MULTIPLEX_HALVES_PAIR, K8_MULTIPLEX_NLOGN_PAIR,
+K8_MULTIPLEX_NLOGNRO_PAIR and K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR) take a kernelpairpb##nn,
+func(state##nn* x, state##nn* y), and hand it pointers straight into the big state. x is what would have been
+passed.state##nn##s[0] and y passed.state##nn##s[1]. Nothing is copied into a state##nnn and back, which matters once
+nn is big. They take no nnn and no iscopy, there's only the one kind of kernel.
+Unlike the copying versions, func sees the elements in place, so x and y must not be used to reach anything else.
+*/
+//Like the copying version, the shared state is copied out once per call and back when the loop is done,
+//so func writing it doesn't make the compiler reload it for every element. The index goes into that copy.
+#define K8_SHARED_STATE_PAIR_PARTIAL_WIND(name, func, nn, nm, start, end, sharedind, nwind, whereind, doind)\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	state##nn shared = a->state##nn##s[sharedind];\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
-	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));/*End is valid*/\
-	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)) );\
 	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
-	K8_STATIC_ASSERT(whereind >= 0);\
 	K8_STATIC_ASSERT(nwind <= nn);\
 	K8_STATIC_ASSERT(whereind >= 0);\
-	K8_STATIC_ASSERT(whereind < (STATE_SIZE(nm)/STATE_SIZE(nn)) );/*There's actually a spot.*/\
-	K8_CONST(a->state##nn##s[sharedind]);\
-	PRAGMA_##alias\
+	K8_STATIC_ASSERT(whereind < (STATE_SIZE(nn) / STATE_SIZE(nwind)) );\
 	for(size_t i = start; i < end; i++){\
-		state##nnn passed;\
-		passed.state##nn##s[0] = a->state##nn##s[sharedind];\
 		if(doind){\
 			state##nwind index; index.u = i;\
-			memcpy(passed.state##nn##s[0].state##nwind##s + whereind, index.state, sizeof(index));\
+			memcpy(shared.state##nwind##s + whereind, index.state, sizeof(index));\
 		}\
-		passed.state##nn##s[1] = a->state##nn##s[i];\
-		K8_SHARED_CALL(iscopy, func)\
-		a->state##nn##s[i] = passed.state##nn##s[1];\
+		func(&shared, a->state##nn##s + i);\
 	}\
+	if(doind) shared.state##nwind##s[whereind] = a->state##nn##s[sharedind].state##nwind##s[whereind];\
+	a->state##nn##s[sharedind] = shared;\
+	K8_PROFILE_END(end-start, (end-start+1)*STATE_SIZE(nn), (end-start+1)*STATE_SIZE(nn))\
 }
 
+#define K8_SHARED_STATE_PAIR_WIND(name, func, nn, nm, nwind, whereind, doind)\
+K8_SHARED_STATE_PAIR_PARTIAL_WIND(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, nwind, whereind, doind)
 
-//Define WIND variants.
-#define K8_RO_SHARED_STATE_PARTIAL_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
-K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, PARALLEL)
+#define K8_SHARED_STATE_PAIR_PARTIAL(name, func, nn, nm, start, end, sharedind)\
+K8_SHARED_STATE_PAIR_PARTIAL_WIND(name, func, nn, nm, start, end, sharedind, 1, 0, 0)
 
-#define K8_RO_SHARED_STATE_PARTIAL_WIND_SUPARA(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
-K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, SUPARA)
+#define K8_SHARED_STATE_PAIR(name, func, nn, nm)\
+K8_SHARED_STATE_PAIR_PARTIAL(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0)
 
-#define K8_RO_SHARED_STATE_PARTIAL_WIND_SIMD(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
-K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, SIMD)
+/*
+Privatized shared state.
+K8_SHARED_STATE_PRIVATE_PARTIAL_ALIAS_WIND(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy, alias)
+is K8_SHARED_STATE_PARTIAL_WIND run in parallel. The range is cut into one contiguous slice per thread,
+and every slice works on its own private copy of the shared statenn, taken before the loop.
+A slice keeps its private in a local while it runs, and stores it back once at the end.
+The index is written into each private just like the serial version writes it, and put back afterwards.
+merge then folds the privates together, in slice order. It takes a pointer to a statenmerge (nmerge must be nn + 2) holding
+	[0] the result so far, starting out as the first slice's private- merge leaves its answer here.
+	[1] the next slice's private.
+	[2] the shared state as it was before the loop, which every private started out as.
+	[3] nothing in particular.
+Having [2] means a counter merges as [0] += [1] - [2], whatever it started at.
+The folded result becomes the new shared state. With one thread (or SIMD and NOPARALLEL) this is the serial loop,
+and merge is never called.
+*/
+#define K8_PRIVATE_CALL(iscopy, func, p) K8_PRIVATE_CALL_##iscopy(func, p)
+#define K8_PRIVATE_CALL_1(func, p) *(p) = func(*(p));
+#define K8_PRIVATE_CALL_0(func, p) func(p);
+
+typedef struct{
+	void* s;
+	void* privates;
+	size_t from, to, per;
+} k8_private_job;
+
+#define K8_SHARED_STATE_PRIVATE_PARTIAL_ALIAS_WIND(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy, alias)\
+K8_SHARED_STATE_PARTIAL_WIND(name##_serial, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+static inline void name##_slice(void* arg, size_t lo, size_t hi){\
+	k8_private_job* j = arg;\
+	state##nm* a = j->s;\
+	for(size_t t = lo; t < hi; t++){\
+		/*Work on a local copy, the privates share cache lines.*/\
+		state##nnn local = ((state##nnn*)j->privates)[t];\
+		state##nnn* passed = &local;\
+		const size_t first = j->from + t * j->per;\
+		const size_t last = first + j->per < j->to ? first + j->per : j->to;\
+		for(size_t i = first; i < last; i++){\
+			passed->state##nn##s[1] = a->state##nn##s[i];\
+			if(doind){\
+				state##nwind index; index.u = i;\
+				memcpy(passed->state##nn##s[0].state##nwind##s + whereind, index.state, sizeof(index));\
+			}\
+			K8_PRIVATE_CALL(iscopy, func, passed)\
+			a->state##nn##s[i] = passed->state##nn##s[1];\
+		}\
+		((state##nnn*)j->privates)[t].state##nn##s[0] = local.state##nn##s[0];\
+	}\
+}\
+static inline void name(state##nm *a){\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)) );\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(nmerge == (nn + 2));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	K8_STATIC_ASSERT(nwind <= nn);\
+	K8_STATIC_ASSERT(whereind >= 0);\
+	K8_STATIC_ASSERT(whereind < (STATE_SIZE(nn) / STATE_SIZE(nwind)) );\
+	size_t slices = K8_ALIAS_THREADED(alias) ? (size_t)k8_parallel_threads() : 1;\
+	if(slices > (size_t)((end)-(start))) slices = (end)-(start);\
+	if(slices < 2){\
+		name##_serial(a);\
+		return;\
+	}\
+	K8_PROFILE_BEGIN(name)\
+	k8_private_job j = {a, malloc(slices * sizeof(state##nnn)), start, end, ((end)-(start) + slices - 1) / slices};\
+	state##nnn* privates = j.privates;\
+	state##nmerge* m = malloc(sizeof(state##nmerge));\
+	if(!privates || !m) {fputs("K8_SHARED_STATE_PRIVATE: out of memory.\n", stderr); abort();}\
+	const state##nwind saved = a->state##nn##s[sharedind].state##nwind##s[whereind];\
+	for(size_t t = 0; t < slices; t++)\
+		privates[t].state##nn##s[0] = a->state##nn##s[sharedind];\
+	k8_parallel_tasks(name##_slice, &j, slices, 1);\
+	m->state##nn##s[0] = privates[0].state##nn##s[0];\
+	m->state##nn##s[2] = a->state##nn##s[sharedind];\
+	if(doind) m->state##nn##s[0].state##nwind##s[whereind] = saved;\
+	for(size_t t = 1; t < slices; t++){\
+		m->state##nn##s[1] = privates[t].state##nn##s[0];\
+		if(doind) m->state##nn##s[1].state##nwind##s[whereind] = saved;\
+		merge(m);\
+	}\
+	a->state##nn##s[sharedind] = m->state##nn##s[0];\
+	free(m);\
+	free(privates);\
+	K8_PROFILE_END(end-start, (end-start+1)*STATE_SIZE(nn), (end-start+1)*STATE_SIZE(nn))\
+}
 
-#define K8_RO_SHARED_STATE_PARTIAL_WIND_NP(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
-K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, NOPARALLEL)
+#define K8_SHARED_STATE_PRIVATE_PARTIAL_WIND(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_ALIAS_WIND(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy, PARALLEL)
 
+#define K8_SHARED_STATE_PRIVATE_PARTIAL_WIND_SUPARA(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_ALIAS_WIND(name, func, merge, nn, nnn, nmerge, nm, start, end, sharedind, nwind, whereind, doind, iscopy, SUPARA)
 
+#define K8_SHARED_STATE_PRIVATE_WIND(name, func, merge, nn, nnn, nmerge, nm,              nwind, whereind, doind, iscopy)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_WIND(name, func, merge, nn, nnn, nmerge, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, nwind, whereind, doind, iscopy)
 
-#define K8_RO_SHARED_STATE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, fuck)\
-K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, 1, 0, 0, iscopy, fuck)
+#define K8_SHARED_STATE_PRIVATE_WIND_SUPARA(name, func, merge, nn, nnn, nmerge, nm,       nwind, whereind, doind, iscopy)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_WIND_SUPARA(name, func, merge, nn, nnn, nmerge, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, nwind, whereind, doind, iscopy)
 
+#define K8_SHARED_STATE_PRIVATE(name, func, merge, nn, nnn, nmerge, nm, iscopy)\
+K8_SHARED_STATE_PRIVATE_PARTIAL_WIND(name, func, merge, nn, nnn, nmerge, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, 1, 0, 0, iscopy)
 
+//Variant in which the shared state is "read only"
 
-#define K8_RO_SHARED_STATE_PARTIAL(name, func, nn, nnn, nm, start, end, sharedind, iscopy)\
+#define K8_RO_SHARED_BODY(func, nn, nnn, sharedind, nwind, whereind, doind, iscopy)\
+	{\
+		state##nnn passed;\
+		passed.state##nn##s[0] = a->state##nn##s[sharedind];\
+		if(doind){\
+			state##nwind index; index.u = i;\
+			memcpy(passed.state##nn##s[0].state##nwind##s + whereind, index.state, sizeof(index));\
+		}\
+		passed.state##nn##s[1] = a->state##nn##s[i];\
+		K8_SHARED_CALL(iscopy, func)\
+		a->state##nn##s[i] = passed.state##nn##s[1];\
+	}
+
+#define K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_RO_SHARED_BODY(func, nn, nnn, sharedind, nwind, whereind, doind, iscopy))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));/*End is valid*/\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	K8_STATIC_ASSERT(whereind >= 0);\
+	K8_STATIC_ASSERT(nwind <= nn);\
+	K8_STATIC_ASSERT(whereind >= 0);\
+	K8_STATIC_ASSERT(whereind < (STATE_SIZE(nm)/STATE_SIZE(nn)) );/*There's actually a spot.*/\
+	K8_CONST(a->state##nn##s[sharedind]);\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(size_t i = start; i < end; i++)\
+		K8_RO_SHARED_BODY(func, nn, nnn, sharedind, nwind, whereind, doind, iscopy)\
+	K8_PROFILE_END(end-start, 2*(end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
+}
+
+
+//Define WIND variants.
+#define K8_RO_SHARED_STATE_PARTIAL_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, PARALLEL)
+
+#define K8_RO_SHARED_STATE_PARTIAL_WIND_SUPARA(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, SUPARA)
+
+#define K8_RO_SHARED_STATE_PARTIAL_WIND_SIMD(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, SIMD)
+
+#define K8_RO_SHARED_STATE_PARTIAL_WIND_NP(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, nwind, whereind, doind, iscopy, NOPARALLEL)
+
+
+
+#define K8_RO_SHARED_STATE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, fuck)\
+K8_RO_SHARED_STATE_PARTIAL_ALIAS_WIND(name, func, nn, nnn, nm, start, end, sharedind, 1, 0, 0, iscopy, fuck)
+
+
+
+#define K8_RO_SHARED_STATE_PARTIAL(name, func, nn, nnn, nm, start, end, sharedind, iscopy)\
 K8_RO_SHARED_STATE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, PARALLEL)
 
 #define K8_RO_SHARED_STATE_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, sharedind, iscopy)\
@@ -1553,6 +3613,586 @@ K8_RO_SHARED_STATE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind,
 #define K8_RO_SHARED_STATE_SIMD(name, func, nn, nnn, nm, iscopy)\
 K8_RO_SHARED_STATE_PARTIAL_SIMD(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy)
 
+//Pair pointer variant. func must not write to the shared state (its first argument)- every thread is reading it.
+//There's no WIND variant, since writing the index into the shared state would take a copy of it per element.
+#define K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, func(a->state##nn##s + (sharedind), a->state##nn##s + i);)\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	K8_CONST(a->state##nn##s[sharedind]);\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(size_t i = start; i < end; i++)\
+		func(a->state##nn##s + (sharedind), a->state##nn##s + i);\
+	K8_PROFILE_END(end-start, (end-start+1)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
+}
+
+#define K8_RO_SHARED_STATE_PAIR_PARTIAL(name, func, nn, nm, start, end, sharedind)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, PARALLEL)
+
+#define K8_RO_SHARED_STATE_PAIR(name, func, nn, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0)
+
+#define K8_RO_SHARED_STATE_PAIR_PARTIAL_SUPARA(name, func, nn, nm, start, end, sharedind)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, SUPARA)
+
+#define K8_RO_SHARED_STATE_PAIR_SUPARA(name, func, nn, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_SUPARA(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0)
+
+#define K8_RO_SHARED_STATE_PAIR_PARTIAL_SIMD(name, func, nn, nm, start, end, sharedind)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, SIMD)
+
+#define K8_RO_SHARED_STATE_PAIR_SIMD(name, func, nn, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_SIMD(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0)
+
+#define K8_RO_SHARED_STATE_PAIR_PARTIAL_NP(name, func, nn, nm, start, end, sharedind)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, sharedind, NOPARALLEL)
+
+#define K8_RO_SHARED_STATE_PAIR_NP(name, func, nn, nm)\
+K8_RO_SHARED_STATE_PAIR_PARTIAL_NP(name, func, nn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0)
+
+/*
+Reduction.
+K8_REDUCE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative, alias)
+folds the statenn's start to end into the one at sharedind, just like K8_SHARED_STATE would with the same func,
+except that the elements are left as they were, and func has to be associative:
+func gets two statenn's in a statennn and leaves their combination in the high half.
+That lets the range be cut into chunks which are folded on their own, in parallel, into one partial each.
+The partials are then combined pairwise, in order- a tree.
+The chunks depend only on the size of the range, never on the thread count, so the answer is always the same.
+With commutative set to 1, func is also declared commutative. Each chunk then merges its partial with whichever
+other partial is done, as soon as it is done, and there is no serial combine at the end.
+The order of those merges is up to the scheduler, so floating point sums won't be bit reproducible in this mode.
+*/
+//Bytes per chunk, at the least.
+#ifndef K8_REDUCE_MIN_BYTES
+#define K8_REDUCE_MIN_BYTES (1<<16)
+#endif
+#ifndef K8_REDUCE_CHUNKS
+#define K8_REDUCE_CHUNKS 64
+#endif
+
+typedef struct{
+	void* s;
+	void* parts;
+	size_t from, to, per;
+	size_t slot;	/*Index + 1 of the finished partial waiting to be merged, commutative mode.*/
+} k8_reduce_job;
+
+//How many chunks a range of n elements of es bytes gets, and how many elements go in each (*per).
+//The count is worked out again from *per, so that no chunk starts past the end of the range.
+static inline size_t k8_reduce_chunks(size_t n, size_t es, size_t* per){
+	*per = (K8_REDUCE_MIN_BYTES + es - 1) / es;
+	size_t chunks = (n + *per - 1) / *per;
+	if(chunks <= 1) return chunks;
+	if(chunks > K8_REDUCE_CHUNKS) chunks = K8_REDUCE_CHUNKS;
+	*per = (n + chunks - 1) / chunks;
+	return (n + *per - 1) / *per;
+}
+
+//x = func(x, y)
+#define K8_REDUCE_COMBINE(func, nn, nnn, iscopy, x, y)\
+	{\
+		state##nnn passed;\
+		passed.state##nn##s[0] = (x);\
+		passed.state##nn##s[1] = (y);\
+		K8_SHARED_CALL(iscopy, func)\
+		(x) = passed.state##nn##s[0];\
+	}
+
+//name##_reduce folds chunks lo to hi of a k8_reduce_job into their partials.
+#define K8_REDUCE_CHUNKS_FN(name, func, nn, nnn, nm, iscopy, commutative)\
+static inline void name##_reduce(void* arg, size_t lo, size_t hi){\
+	k8_reduce_job* j = arg;\
+	state##nm* a = j->s;\
+	state##nn* parts = j->parts;\
+	for(size_t c = lo; c < hi; c++){\
+		const size_t first = j->from + c * j->per;\
+		const size_t last = first + j->per < j->to ? first + j->per : j->to;\
+		state##nnn passed;\
+		passed.state##nn##s[0] = a->state##nn##s[first];\
+		for(size_t i = first + 1; i < last; i++){\
+			passed.state##nn##s[1] = a->state##nn##s[i];\
+			K8_SHARED_CALL(iscopy, func)\
+		}\
+		parts[c] = passed.state##nn##s[0];\
+		if(commutative) for(size_t mine = c;;){\
+			/*Merge with a waiting partial, or wait ourselves if there isn't one.*/\
+			size_t other = __atomic_exchange_n(&j->slot, 0, __ATOMIC_ACQ_REL), empty = 0;\
+			if(other) {K8_REDUCE_COMBINE(func, nn, nnn, iscopy, parts[mine], parts[other-1]); continue;}\
+			if(__atomic_compare_exchange_n(&j->slot, &empty, mine + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) break;\
+		}\
+	}\
+}
+
+#define K8_REDUCE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative, alias)\
+K8_REDUCE_CHUNKS_FN(name, func, nn, nnn, nm, iscopy, commutative)\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	size_t per;\
+	const size_t chunks = k8_reduce_chunks((end)-(start), STATE_SIZE(nn), &per);\
+	if(chunks > 1 && K8_ALIAS_THREADED(alias) && k8_parallel_threads() > 1){\
+		k8_reduce_job j = {a, malloc(chunks * sizeof(state##nn)), start, end, per, 0};\
+		state##nn* parts = j.parts;\
+		if(!parts) {fputs("K8_REDUCE: out of memory.\n", stderr); abort();}\
+		k8_parallel_tasks(name##_reduce, &j, chunks, 1);\
+		size_t done = 0;\
+		if(commutative) done = j.slot - 1;\
+		else for(size_t stride = 1; stride < chunks; stride *= 2)\
+			for(size_t c = 0; c + stride < chunks; c += 2 * stride)\
+				K8_REDUCE_COMBINE(func, nn, nnn, iscopy, parts[c], parts[c + stride])\
+		K8_REDUCE_COMBINE(func, nn, nnn, iscopy, a->state##nn##s[sharedind], parts[done])\
+		free(parts);\
+	} else {\
+		state##nnn passed;\
+		passed.state##nn##s[0] = a->state##nn##s[sharedind];\
+		for(size_t i = start; i < end; i++){\
+			passed.state##nn##s[1] = a->state##nn##s[i];\
+			K8_SHARED_CALL(iscopy, func)\
+		}\
+		a->state##nn##s[sharedind] = passed.state##nn##s[0];\
+	}\
+	K8_PROFILE_END(end-start, (end-start+1)*STATE_SIZE(nn), STATE_SIZE(nn))\
+}
+
+#define K8_REDUCE_PARTIAL(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative)\
+K8_REDUCE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative, PARALLEL)
+
+#define K8_REDUCE_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative)\
+K8_REDUCE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative, SUPARA)
+
+#define K8_REDUCE_PARTIAL_NP(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative)\
+K8_REDUCE_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, commutative, NOPARALLEL)
+
+//Same shape as K8_SHARED_STATE- the first statenn is the accumulator, the rest are reduced into it.
+#define K8_REDUCE(name, func, nn, nnn, nm, iscopy, commutative)\
+K8_REDUCE_PARTIAL(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, commutative)
+
+#define K8_REDUCE_SUPARA(name, func, nn, nnn, nm, iscopy, commutative)\
+K8_REDUCE_PARTIAL_SUPARA(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, commutative)
+
+#define K8_REDUCE_NP(name, func, nn, nnn, nm, iscopy, commutative)\
+K8_REDUCE_PARTIAL_NP(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, commutative)
+
+/*
+Prefix scan.
+K8_SCAN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive, alias)
+replaces every statenn from start to end with the running combination of the ones before it-
+including itself, or with exclusive set to 1, not including itself.
+func is the same kind of associative combine kernel as K8_REDUCE's: the running value comes in the high half,
+the element in the low half, and their combination goes in the high half.
+The running value starts out as the statenn at sharedind, which ends up holding the combination of all of them.
+So for a sum, put a zero there first- it's also where the total comes out.
+The range is cut into the same chunks K8_REDUCE uses. Each chunk is reduced on its own, in parallel,
+the chunk totals are scanned (serially, there are at most K8_REDUCE_CHUNKS of them), and then every chunk
+is scanned in parallel starting from its total. That reads the range twice and writes it once.
+Within a chunk the scan is one dependent chain, so there is nothing for SIMD to do with an arbitrary func-
+SIMD and NOPARALLEL just run the serial loop.
+*/
+#define K8_SCAN_STEP(func, nn, nnn, iscopy, exclusive, run, x)\
+	if(exclusive){\
+		state##nn k8e = (x);\
+		(x) = (run);\
+		K8_REDUCE_COMBINE(func, nn, nnn, iscopy, run, k8e)\
+	} else {\
+		K8_REDUCE_COMBINE(func, nn, nnn, iscopy, run, x)\
+		(x) = (run);\
+	}
+
+#define K8_SCAN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive, alias)\
+K8_REDUCE_CHUNKS_FN(name, func, nn, nnn, nm, iscopy, 0)\
+/*Scan chunks lo to hi, each starting from the running value the job's parts hold for it, and leaving its last one there.*/\
+static inline void name##_scan(void* arg, size_t lo, size_t hi){\
+	k8_reduce_job* j = arg;\
+	state##nm* a = j->s;\
+	state##nn* parts = j->parts;\
+	for(size_t c = lo; c < hi; c++){\
+		const size_t first = j->from + c * j->per;\
+		const size_t last = first + j->per < j->to ? first + j->per : j->to;\
+		state##nn run = parts[c];\
+		for(size_t i = first; i < last; i++)\
+			K8_SCAN_STEP(func, nn, nnn, iscopy, exclusive, run, a->state##nn##s[i])\
+		parts[c] = run;\
+	}\
+}\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	size_t per;\
+	const size_t chunks = k8_reduce_chunks((end)-(start), STATE_SIZE(nn), &per);\
+	if(chunks > 1 && K8_ALIAS_THREADED(alias) && k8_parallel_threads() > 1){\
+		k8_reduce_job j = {a, malloc(chunks * sizeof(state##nn)), start, end, per, 0};\
+		state##nn* parts = j.parts;\
+		if(!parts) {fputs("K8_SCAN: out of memory.\n", stderr); abort();}\
+		/*The last chunk's total is never needed.*/\
+		k8_parallel_tasks(name##_reduce, &j, chunks - 1, 1);\
+		state##nn run = a->state##nn##s[sharedind];\
+		for(size_t c = 0; c + 1 < chunks; c++)\
+			K8_SCAN_STEP(func, nn, nnn, iscopy, 1, run, parts[c])\
+		parts[chunks - 1] = run;\
+		k8_parallel_tasks(name##_scan, &j, chunks, 1);\
+		a->state##nn##s[sharedind] = parts[chunks - 1];\
+		free(parts);\
+	} else {\
+		state##nn run = a->state##nn##s[sharedind];\
+		for(size_t i = start; i < end; i++)\
+			K8_SCAN_STEP(func, nn, nnn, iscopy, exclusive, run, a->state##nn##s[i])\
+		a->state##nn##s[sharedind] = run;\
+	}\
+	K8_PROFILE_END(end-start, 2*(end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
+}
+
+#define K8_SCAN_PARTIAL(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive)\
+K8_SCAN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive, PARALLEL)
+
+#define K8_SCAN_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive)\
+K8_SCAN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive, SUPARA)
+
+#define K8_SCAN_PARTIAL_NP(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive)\
+K8_SCAN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, sharedind, iscopy, exclusive, NOPARALLEL)
+
+//Like K8_REDUCE, the first statenn is the running value and the total, the rest are scanned.
+#define K8_SCAN_INCLUSIVE(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 0)
+
+#define K8_SCAN_EXCLUSIVE(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 1)
+
+#define K8_SCAN_INCLUSIVE_SUPARA(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL_SUPARA(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 0)
+
+#define K8_SCAN_EXCLUSIVE_SUPARA(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL_SUPARA(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 1)
+
+#define K8_SCAN_INCLUSIVE_NP(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL_NP(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 0)
+
+#define K8_SCAN_EXCLUSIVE_NP(name, func, nn, nnn, nm, iscopy)\
+K8_SCAN_PARTIAL_NP(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy, 1)
+
+/*
+Loop fusion.
+Running several multiplexers over the same big state one after another sweeps all of memory once per multiplexer.
+K8_MULTIPLEX_FUSED_ALIAS(name, nm, nalign, alias, stages...) makes one multiplexer which cuts the statenm
+into tiles of K8_FUSED_TILE_BYTES and runs every stage on a tile, in order, before moving on to the next tile-
+so only the first stage has to go out to DRAM for it.
+A stage is a function void stage(void* a, size_t lo, size_t hi) which processes bytes lo to hi of the statenm,
+made by one of
+	K8_FUSED_STAGE(stage, func, nn, nm, iscopy)				like K8_MULTIPLEX
+	K8_FUSED_STAGE_INDEXED(stage, func, nn, nnn, nm, iscopy)	like K8_MULTIPLEX_INDEXED
+	K8_FUSED_STAGE_RO_SHARED(stage, func, nn, nnn, nm, iscopy)	like K8_RO_SHARED_STATE
+or their _PARTIAL versions, which take start and end (and sharedind) like the multiplexers do.
+nalign is the largest nn of any stage. Tiles are a whole number of those, never less than one.
+This gives the same answer as running the stages one after another only when every stage's element i depends on
+nothing but element i. The one exception is the shared element of a RO_SHARED stage, which no stage may write-
+use _PARTIAL stages to keep the others off of it.
+Tiles are spread over the threads for PARALLEL and SUPARA.
+*/
+//Bytes per tile. Small enough that a tile stays in L2 across all the stages.
+#ifndef K8_FUSED_TILE_BYTES
+#define K8_FUSED_TILE_BYTES (1<<18)
+#endif
+
+//A stage's piece of the tile, in elements: bytes lo to hi, cut down to elements start to end.
+#define K8_FUSED_RANGE(nn, start, end)\
+	size_t first = lo / STATE_SIZE(nn), last = hi / STATE_SIZE(nn);\
+	if(first < (size_t)(start)) first = (start);\
+	if(last > (size_t)(end)) last = (end);
+
+#define K8_FUSED_STAGE_PARTIAL(stage, func, nn, nm, start, end, iscopy)\
+static inline void stage(void* k8a, size_t lo, size_t hi){\
+	state##nm* a = k8a;\
+	K8_FUSED_RANGE(nn, start, end)\
+	for(size_t i = first; i < last; i++)\
+		K8_MULTIPLEX_CALLP(iscopy, func, nn);\
+}
+
+#define K8_FUSED_STAGE_INDEXED_PARTIAL(stage, func, nn, nnn, nm, start, end, iscopy)\
+static inline void stage(void* k8a, size_t lo, size_t hi){\
+	state##nm* a = k8a;\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_FUSED_RANGE(nn, start, end)\
+	for(ssize_t i = first; i < (ssize_t)last; i++)\
+		K8_MULTIPLEX_INDEXED_BODY(func, nn, nnn, iscopy)\
+}
+
+#define K8_FUSED_STAGE_RO_SHARED_PARTIAL(stage, func, nn, nnn, nm, start, end, sharedind, iscopy)\
+static inline void stage(void* k8a, size_t lo, size_t hi){\
+	state##nm* a = k8a;\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	K8_STATIC_ASSERT(!(sharedind >= start && sharedind < end));\
+	K8_FUSED_RANGE(nn, start, end)\
+	for(size_t i = first; i < last; i++)\
+		K8_RO_SHARED_BODY(func, nn, nnn, sharedind, 1, 0, 0, iscopy)\
+}
+
+#define K8_FUSED_STAGE(stage, func, nn, nm, iscopy)\
+K8_FUSED_STAGE_PARTIAL(stage, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_FUSED_STAGE_INDEXED(stage, func, nn, nnn, nm, iscopy)\
+K8_FUSED_STAGE_INDEXED_PARTIAL(stage, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+//Like K8_RO_SHARED_STATE, the first element is the shared one.
+#define K8_FUSED_STAGE_RO_SHARED(stage, func, nn, nnn, nm, iscopy)\
+K8_FUSED_STAGE_RO_SHARED_PARTIAL(stage, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STATE_SIZE(nn)), 0, iscopy)
+
+typedef struct{
+	void* s;
+	const k8_rangefn* stages;
+	size_t nstages, tile, bytes;
+} k8_fused_job;
+
+static inline void k8_fused_tiles(void* arg, size_t lo, size_t hi){
+	const k8_fused_job* j = arg;
+	for(size_t t = lo; t < hi; t++){
+		const size_t first = t * j->tile;
+		const size_t last = first + j->tile < j->bytes ? first + j->tile : j->bytes;
+		for(size_t s = 0; s < j->nstages; s++)
+			j->stages[s](j->s, first, last);
+	}
+}
+
+#define K8_MULTIPLEX_FUSED_ALIAS(name, nm, nalign, alias, ...)\
+static inline void name(state##nm *a){\
+	static const k8_rangefn stages[] = {__VA_ARGS__};\
+	K8_PROFILE_BEGIN(name)\
+	K8_STATIC_ASSERT(nalign <= nm);\
+	size_t tile = K8_FUSED_TILE_BYTES;\
+	if(tile < STATE_SIZE(nalign)) tile = STATE_SIZE(nalign);\
+	tile -= tile % STATE_SIZE(nalign);\
+	k8_fused_job j = {a, stages, sizeof(stages)/sizeof(stages[0]), tile, STATE_SIZE(nm)};\
+	k8_parallel_tasks(k8_fused_tiles, &j, (STATE_SIZE(nm) + tile - 1) / tile, K8_ALIAS_THREADED(alias));\
+	K8_PROFILE_END(STATE_SIZE(nm)/STATE_SIZE(nalign), STATE_SIZE(nm), STATE_SIZE(nm))\
+}
+
+#define K8_MULTIPLEX_FUSED(name, nm, nalign, ...)\
+K8_MULTIPLEX_FUSED_ALIAS(name, nm, nalign, PARALLEL, __VA_ARGS__)
+
+#define K8_MULTIPLEX_FUSED_SUPARA(name, nm, nalign, ...)\
+K8_MULTIPLEX_FUSED_ALIAS(name, nm, nalign, SUPARA, __VA_ARGS__)
+
+#define K8_MULTIPLEX_FUSED_NP(name, nm, nalign, ...)\
+K8_MULTIPLEX_FUSED_ALIAS(name, nm, nalign, NOPARALLEL, __VA_ARGS__)
+
+/*
+Auto multiplexers.
+K8_MULTIPLEX_AUTO(name, func, nn, nm, iscopy) is K8_MULTIPLEX, except nobody picks the alias-
+it measures which way of running is fastest for this kernel on this state, and keeps to that.
+The ways (paths) it has are
+	0 serial, as NOPARALLEL
+	1 SIMD
+	2, 3, 4 threaded, the elements cut in 1, 4 or 16 chunks per thread, on whichever backend is in use.
+Threaded paths are only tried with more than one thread. The first K8_AUTO_TRIALS calls to each path are
+timed, taking turns, and from then on it takes the path with the fastest call. Calibrating calls do the
+real work, so nothing is run twice. Calls made while another thread is registering it run serially, untimed.
+With the K8_AUTO_FILE environment variable naming a file, a multiplexer looks itself up in it (by name,
+state size and thread count) on first use, and if it's there it skips calibration. Every choice is written
+back to the file at exit, merged with what was there already.
+With K8_AUTO_REPORT set, the table of choices goes to stderr at exit: the fastest call of every path,
+in nanoseconds, and which one won. k8_auto_report(f) writes it to f at any time.
+The choice is made with whatever data the calibrating calls had, and the thread count of the first call.
+*/
+#ifndef K8_AUTO_TRIALS
+#define K8_AUTO_TRIALS 3
+#endif
+#define K8_AUTO_PATHS 5
+
+typedef struct k8_auto_rec{
+	const char* name;
+	size_t bytes;
+	int path;		/*The choice, -1 while calibrating.*/
+	int registered;	/*0, 1 while registering, 2 once registered.*/
+	int threads;
+	int paths;		/*How many paths get tried.*/
+	uint32_t trials, timed;
+	uint64_t best[K8_AUTO_PATHS];	/*Fastest call, in nanoseconds. 0 if not tried.*/
+	struct k8_auto_rec* next;
+} k8_auto_rec;
+
+typedef struct{
+	void* a;
+	size_t count, per;
+} k8_auto_job;
+
+static k8_auto_rec* k8_auto_head = NULL;
+static const char* const k8_auto_names[K8_AUTO_PATHS] = {"serial", "simd", "threads", "threads*4", "threads*16"};
+
+static void k8_auto_report(FILE* f){
+	fprintf(f, "%-40s %12s %8s %-10s", "K8_MULTIPLEX_AUTO", "bytes", "threads", "choice");
+	for(int p = 0; p < K8_AUTO_PATHS; p++) fprintf(f, " %12s", k8_auto_names[p]);
+	fputc('\n', f);
+	for(k8_auto_rec* r = __atomic_load_n(&k8_auto_head, __ATOMIC_ACQUIRE); r; r = r->next){
+		const int path = __atomic_load_n(&r->path, __ATOMIC_ACQUIRE);
+		fprintf(f, "%-40s %12zu %8d %-10s", r->name, r->bytes, r->threads, path < 0 ? "-" : k8_auto_names[path]);
+		for(int p = 0; p < K8_AUTO_PATHS; p++){
+			const uint64_t ns = __atomic_load_n(r->best + p, __ATOMIC_RELAXED);
+			if(ns) fprintf(f, " %12llu", (unsigned long long)ns);
+			else fprintf(f, " %12s", "-");
+		}
+		fputc('\n', f);
+	}
+}
+
+//A line of the tuning file is: name bytes threads path best0 ... best4
+static int k8_auto_parse(const char* line, char* name, size_t* bytes, int* threads, int* path, uint64_t* best){
+	unsigned long long b[K8_AUTO_PATHS];
+	if(sscanf(line, "%255s %zu %d %d %llu %llu %llu %llu %llu", name, bytes, threads, path, b, b+1, b+2, b+3, b+4) != 4 + K8_AUTO_PATHS)
+		return 0;
+	for(int p = 0; p < K8_AUTO_PATHS; p++) best[p] = b[p];
+	return *path >= 0 && *path < K8_AUTO_PATHS;
+}
+
+static inline int k8_auto_same(const k8_auto_rec* r, const char* name, size_t bytes, int threads){
+	return r->bytes == bytes && r->threads == threads && !strcmp(r->name, name);
+}
+
+//The path r takes according to the tuning file, or -1.
+static int k8_auto_load(k8_auto_rec* r){
+	const char* path = getenv("K8_AUTO_FILE");
+	FILE* f = path ? fopen(path, "r") : NULL;
+	int found = -1;
+	if(!f) return found;
+	char line[512], name[256];
+	size_t bytes;
+	int threads, choice;
+	uint64_t best[K8_AUTO_PATHS];
+	while(fgets(line, sizeof(line), f))
+		if(k8_auto_parse(line, name, &bytes, &threads, &choice, best) && k8_auto_same(r, name, bytes, threads) && choice < r->paths){
+			memcpy(r->best, best, sizeof(best));
+			found = choice;
+		}
+	fclose(f);
+	return found;
+}
+
+//Keep the lines of the old file which aren't about this program's multiplexers, and add those.
+static void k8_auto_save(const char* path){
+	FILE* old = fopen(path, "r");
+	char* kept = NULL;
+	size_t nkept = 0;
+	if(old){
+		char line[512], name[256];
+		size_t bytes;
+		int threads, choice;
+		uint64_t best[K8_AUTO_PATHS];
+		while(fgets(line, sizeof(line), old)){
+			if(!k8_auto_parse(line, name, &bytes, &threads, &choice, best)) continue;
+			int mine = 0;
+			for(k8_auto_rec* r = k8_auto_head; r && !mine; r = r->next)
+				mine = r->path >= 0 && k8_auto_same(r, name, bytes, threads);
+			if(mine) continue;
+			const size_t len = strlen(line);
+			char* grown = realloc(kept, nkept + len + 1);
+			if(!grown) break;
+			kept = grown;
+			memcpy(kept + nkept, line, len + 1);
+			nkept += len;
+		}
+		fclose(old);
+	}
+	FILE* f = fopen(path, "w");
+	if(f){
+		if(nkept) fputs(kept, f);
+		for(k8_auto_rec* r = k8_auto_head; r; r = r->next){
+			if(r->path < 0) continue;
+			fprintf(f, "%s %zu %d %d", r->name, r->bytes, r->threads, r->path);
+			for(int p = 0; p < K8_AUTO_PATHS; p++) fprintf(f, " %llu", (unsigned long long)r->best[p]);
+			fputc('\n', f);
+		}
+		fclose(f);
+	}
+	free(kept);
+}
+
+static void k8_auto_exit(void){
+	const char* path = getenv("K8_AUTO_FILE");
+	if(path) k8_auto_save(path);
+	if(getenv("K8_AUTO_REPORT")) k8_auto_report(stderr);
+}
+
+//Which path this call takes. *timed is set if it is a calibrating call.
+static inline int k8_auto_begin(k8_auto_rec* r, int* timed){
+	*timed = 0;
+	const int path = __atomic_load_n(&r->path, __ATOMIC_ACQUIRE);
+	if(path >= 0) return path;
+	if(__atomic_load_n(&r->registered, __ATOMIC_ACQUIRE) != 2){
+		int expected = 0;
+		if(!__atomic_compare_exchange_n(&r->registered, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return 0;
+		r->threads = k8_parallel_threads();
+		r->paths = r->threads > 1 ? K8_AUTO_PATHS : 2;
+		const int found = k8_auto_load(r);
+		r->next = __atomic_load_n(&k8_auto_head, __ATOMIC_ACQUIRE);
+		while(!__atomic_compare_exchange_n(&k8_auto_head, &r->next, r, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+		if(r->next == NULL) atexit(k8_auto_exit);
+		__atomic_store_n(&r->registered, 2, __ATOMIC_RELEASE);
+		if(found >= 0) {__atomic_store_n(&r->path, found, __ATOMIC_RELEASE); return found;}
+	}
+	const uint32_t trial = __atomic_fetch_add(&r->trials, 1, __ATOMIC_RELAXED);
+	if(trial >= (uint32_t)(K8_AUTO_TRIALS * r->paths)) return 0; /*Every trial is taken but not all are in yet.*/
+	*timed = 1;
+	return (int)(trial % (uint32_t)r->paths);
+}
+
+static inline void k8_auto_end(k8_auto_rec* r, int path, int timed, uint64_t ns){
+	if(!timed) return;
+	if(!ns) ns = 1;
+	uint64_t best = __atomic_load_n(r->best + path, __ATOMIC_RELAXED);
+	while((!best || ns < best) && !__atomic_compare_exchange_n(r->best + path, &best, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	if(__atomic_add_fetch(&r->timed, 1, __ATOMIC_ACQ_REL) != (uint32_t)(K8_AUTO_TRIALS * r->paths)) return;
+	int choice = 0;
+	for(int p = 1; p < r->paths; p++)
+		if(__atomic_load_n(r->best + p, __ATOMIC_RELAXED) < __atomic_load_n(r->best + choice, __ATOMIC_RELAXED)) choice = p;
+	__atomic_store_n(&r->path, choice, __ATOMIC_RELEASE);
+}
+
+//Elements per chunk for threaded path number path.
+static inline size_t k8_auto_per(int path, int threads, size_t count){
+	size_t chunks = (size_t)threads << (2 * (path - 2));
+	if(chunks > count) chunks = count;
+	if(chunks < 1) chunks = 1;
+	return (count + chunks - 1) / chunks;
+}
+
+#define K8_MULTIPLEX_AUTO(name, func, nn, nm, iscopy)\
+K8_MULTIPLEX_PARTIAL_ALIAS(name##_auto_np, func, nn, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, NOPARALLEL)\
+K8_MULTIPLEX_PARTIAL_ALIAS(name##_auto_simd, func, nn, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, SIMD)\
+static inline void name##_auto_chunks(void* k8j, size_t lo, size_t hi){\
+	const k8_auto_job* j = k8j;\
+	state##nm* a = j->a;\
+	const size_t end = hi * j->per < j->count ? hi * j->per : j->count;\
+	for(size_t i = lo * j->per; i < end; i++)\
+		K8_MULTIPLEX_CALLP(iscopy, func, nn);\
+}\
+static inline void name(state##nm *a){\
+	static k8_auto_rec rec = {#name, STATE_SIZE(nm), -1};\
+	const size_t count = (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn));\
+	K8_PROFILE_BEGIN(name)\
+	int timed;\
+	const int path = k8_auto_begin(&rec, &timed);\
+	const uint64_t t0 = timed ? k8_wtime_ns() : 0;\
+	if(path == 0) name##_auto_np(a);\
+	else if(path == 1) name##_auto_simd(a);\
+	else {\
+		k8_auto_job j = {a, count, k8_auto_per(path, rec.threads, count)};\
+		k8_parallel_tasks(name##_auto_chunks, &j, (count + j.per - 1) / j.per, 1);\
+	}\
+	k8_auto_end(&rec, path, timed, timed ? k8_wtime_ns() - t0 : 0);\
+	K8_PROFILE_END(count, count*STATE_SIZE(nn), count*STATE_SIZE(nn))\
+}
+
 #define K8_MHALVES_CALLP(iscopy, func) K8_MHALVES_CALLP_##iscopy(func)
 #define K8_MHALVES_CALLP_1(func) passed = func(passed);
 #define K8_MHALVES_CALLP_0(func) func(&passed);
@@ -1561,22 +4201,29 @@ K8_RO_SHARED_STATE_PARTIAL_SIMD(name, func, nn, nnn, nm, 1, (STATE_SIZE(nm)/STAT
 #define K8_MHALVES_CALL(iscopy, func) K8_MHALVES_CALL_##iscopy(func)
 #define K8_MHALVES_CALL_1(func) passed = func(passed);
 #define K8_MHALVES_CALL_0(func) func(&passed);
+#define K8_MHALVES_BODY(func, nn, nnn, nm, iscopy)\
+	{\
+		state##nnn passed;\
+		passed.state##nn##s[0] = state_ptr_high##nm(a)->state##nn##s[i];\
+		passed.state##nn##s[1] = state_ptr_low##nm(a)->state##nn##s[i];\
+		K8_MHALVES_CALLP(iscopy, func)\
+		state_ptr_high##nm(a)->state##nn##s[i] = passed.state##nn##s[0];\
+		state_ptr_low##nm(a)->state##nn##s[i] = passed.state##nn##s[1];\
+	}
 //Multiplex on halves.
 #define K8_MULTIPLEX_HALVES_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_MHALVES_BODY(func, nn, nnn, nm, iscopy))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a, STATE_SIZE(nm), K8_ADV_SEQUENTIAL)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= ((STATE_SIZE(nm)/STATE_SIZE(nn))/2));\
 	K8_STATIC_ASSERT(nnn == (nn + 1));\
-	PRAGMA_##alias\
-	for(size_t i = start; i < end; i++){\
-		state##nnn passed;\
-		passed.state##nn##s[0] = state_ptr_high##nm(a)->state##nn##s[i];\
-		passed.state##nn##s[1] = state_ptr_low##nm(a)->state##nn##s[i];\
-		K8_MHALVES_CALLP(iscopy, func)\
-		state_ptr_high##nm(a)->state##nn##s[i] = passed.state##nn##s[0];\
-		state_ptr_low##nm(a)->state##nn##s[i] = passed.state##nn##s[1];\
-	}\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(size_t i = start; i < end; i++)\
+		K8_MHALVES_BODY(func, nn, nnn, nm, iscopy)\
+	K8_PROFILE_END(end-start, 2*(end-start)*STATE_SIZE(nn), 2*(end-start)*STATE_SIZE(nn))\
 }
 
 #define K8_MULTIPLEX_HALVES_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
@@ -1603,6 +4250,48 @@ K8_MULTIPLEX_HALVES_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, N
 #define K8_MULTIPLEX_HALVES_NP(name, func, nn, nnn, nm, iscopy)\
 K8_MULTIPLEX_HALVES_PARTIAL_NP(name, func, nn, nnn, nm, 0, ((STATE_SIZE(nm)/STATE_SIZE(nn))/2), iscopy)
 
+//Pair pointer variant. func gets element i of the high half, then element i of the low half.
+#define K8_MHALVES_PAIR_BODY(func, nn, nm)\
+	func(state_ptr_high##nm(a)->state##nn##s + i, state_ptr_low##nm(a)->state##nn##s + i);
+
+#define K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_MHALVES_PAIR_BODY(func, nn, nm))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a, STATE_SIZE(nm), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= ((STATE_SIZE(nm)/STATE_SIZE(nn))/2));\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(size_t i = start; i < end; i++)\
+		K8_MHALVES_PAIR_BODY(func, nn, nm)\
+	K8_PROFILE_END(end-start, 2*(end-start)*STATE_SIZE(nn), 2*(end-start)*STATE_SIZE(nn))\
+}
+
+#define K8_MULTIPLEX_HALVES_PAIR_PARTIAL(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, PARALLEL)
+
+#define K8_MULTIPLEX_HALVES_PAIR(name, func, nn, nm)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL(name, func, nn, nm, 0, ((STATE_SIZE(nm)/STATE_SIZE(nn))/2))
+
+#define K8_MULTIPLEX_HALVES_PAIR_PARTIAL_SUPARA(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, SUPARA)
+
+#define K8_MULTIPLEX_HALVES_PAIR_SUPARA(name, func, nn, nm)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_SUPARA(name, func, nn, nm, 0, ((STATE_SIZE(nm)/STATE_SIZE(nn))/2))
+
+#define K8_MULTIPLEX_HALVES_PAIR_PARTIAL_SIMD(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, SIMD)
+
+#define K8_MULTIPLEX_HALVES_PAIR_SIMD(name, func, nn, nm)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_SIMD(name, func, nn, nm, 0, ((STATE_SIZE(nm)/STATE_SIZE(nn))/2))
+
+#define K8_MULTIPLEX_HALVES_PAIR_PARTIAL_NP(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, NOPARALLEL)
+
+#define K8_MULTIPLEX_HALVES_PAIR_NP(name, func, nn, nm)\
+K8_MULTIPLEX_HALVES_PAIR_PARTIAL_NP(name, func, nn, nm, 0, ((STATE_SIZE(nm)/STATE_SIZE(nn))/2))
+
 
 #define K8_MULTIK8_CALL(iscopy, funcarr, nn) K8_MULTIK8_CALL_##iscopy(funcarr, nn)
 #define K8_MULTIK8_CALL_1(funcarr, nn) a->state##nn##s[i] = (funcarr[i])(a->state##nn##s[i]);
@@ -1611,13 +4300,17 @@ K8_MULTIPLEX_HALVES_PARTIAL_NP(name, func, nn, nnn, nm, 0, ((STATE_SIZE(nm)/STAT
 //
 
 #define K8_MULTIPLEX_MULTIK8_PARTIAL_ALIAS(name, funcarr, nn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, K8_MULTIK8_CALL(iscopy, funcarr, nn))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
-	PRAGMA_##alias\
+	K8_PARFOR(alias, name, a, (end)-(start))\
 	for(ssize_t i = start; i < end; i++)\
 		K8_MULTIK8_CALL(iscopy, funcarr, nn);\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
 }
 
 #define K8_MULTIPLEX_MULTIK8_PARTIAL(name, funcarr, nn, nm, start, end, iscopy)\
@@ -1644,6 +4337,66 @@ K8_MULTIPLEX_MULTIK8_PARTIAL_ALIAS(name, funcarr, nn, nm, start, end, iscopy, NO
 #define K8_MULTIPLEX_MULTIK8_NP(name, funcarr, nn, nm, iscopy)\
 K8_MULTIPLEX_MULTIK8_PARTIAL_NP(name, funcarr, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
 
+/*
+MULTIK8 with the kernels listed at compile time instead of in an array of function pointers,
+so that every one of them is inlined (README item 10). list is an X-macro naming the kernels:
+	#define AND_7667(X) X(and127) X(and63) X(and63) X(and127)
+	K8_MULTIPLEX_MULTIK8_LIST_NP(and_7667, AND_7667, 1, 3, 0)
+Element i gets the kernel at i modulo the length of the list (the period), so a list as long as the
+range does what K8_MULTIPLEX_MULTIK8 does with an array, and a short list repeats over a big state.
+start and end must be multiples of the period. The loop takes a period at a time, with a call
+written out for each kernel in the list.
+*/
+#define K8_MULTIK8_COUNT(func) +1
+#define K8_MULTIK8_PERIOD(list) (0 list(K8_MULTIK8_COUNT))
+#define K8_MULTIK8_LANE_1(func) *k8p = func(*k8p); k8p++;
+#define K8_MULTIK8_LANE_0(func) func(k8p); k8p++;
+#define K8_MULTIK8_LIST_BODY(list, nn, iscopy)\
+	{\
+		state##nn* k8p = a->state##nn##s + i;\
+		list(K8_MULTIK8_LANE_##iscopy)\
+	}
+
+#define K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, K8_MULTIK8_PERIOD(list), K8_MULTIK8_LIST_BODY(list, nn, iscopy))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT((start) % K8_MULTIK8_PERIOD(list) == 0);\
+	K8_STATIC_ASSERT((end) % K8_MULTIK8_PERIOD(list) == 0);\
+	K8_PARFOR(alias, name, a, ((end)-(start))/K8_MULTIK8_PERIOD(list))\
+	for(ssize_t i = start; i < end; i += K8_MULTIK8_PERIOD(list))\
+		K8_MULTIK8_LIST_BODY(list, nn, iscopy)\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(nn), (end-start)*STATE_SIZE(nn))\
+}
+
+#define K8_MULTIPLEX_MULTIK8_LIST_PARTIAL(name, list, nn, nm, start, end, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, PARALLEL)
+
+#define K8_MULTIPLEX_MULTIK8_LIST(name, list, nn, nm, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL(name, list, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_SUPARA(name, list, nn, nm, start, end, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, SUPARA)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_SUPARA(name, list, nn, nm, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_SUPARA(name, list, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_SIMD(name, list, nn, nm, start, end, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, SIMD)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_SIMD(name, list, nn, nm, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_SIMD(name, list, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_NP(name, list, nn, nm, start, end, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_ALIAS(name, list, nn, nm, start, end, iscopy, NOPARALLEL)
+
+#define K8_MULTIPLEX_MULTIK8_LIST_NP(name, list, nn, nm, iscopy)\
+K8_MULTIPLEX_MULTIK8_LIST_PARTIAL_NP(name, list, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
 
 
 
@@ -1653,53 +4406,351 @@ K8_MULTIPLEX_MULTIK8_PARTIAL_NP(name, funcarr, nn, nm, 0, (STATE_SIZE(nm)/STATE_
 #define K8_MULTIPLEX_NLOGN_CALLP_1(func) current_b = func(current_b);
 #define K8_MULTIPLEX_NLOGN_CALLP_0(func) func(&current_b);
 
-//NLOGN implementation.
-//Parallelism cannot be used.
-#define K8_MULTIPLEX_NLOGN_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
+//Number of i,j pairs visited by the NLOGN multiplexers.
+#define K8_NLOGN_PAIRS(start, end) ((uint64_t)((end)-(start)) * (uint64_t)((end)-(start) > 0 ? (end)-(start)-1 : 0) / 2)
+
+/*
+NLOGN implementation.
+Every pair of elements i < j is passed to func, and both are written back. In serial order that's
+for(i = start; i < end-1; i++) for(j = i+1; j < end; j++)- element i is carried along the whole j loop.
+
+The elements are cut into tiles of K8_NLOGN_TILE(nn) elements, and the pairs into blocks (I, J), I <= J,
+holding the pairs with i in tile I and j in tile J. Each block is done in the serial order, keeping both tiles in L1.
+Block (I, J) only touches tiles I and J, and the blocks touching a tile come in the serial order if the blocks
+are run in wavefronts of I+J. The blocks of one wavefront touch different tiles, so they run in parallel.
+Every element sees the same sequence of pairs it would have in the serial loop, so as long as func
+only reads and writes the pair it's given, the result is exactly the serial one.
+*/
+#ifndef K8_NLOGN_TILE_BYTES
+#define K8_NLOGN_TILE_BYTES 4096
+#endif
+#define K8_NLOGN_TILE(nn) (K8_NLOGN_TILE_BYTES / STATE_SIZE(nn) > 0 ? K8_NLOGN_TILE_BYTES / STATE_SIZE(nn) : 1)
+
+//One wavefront of an NLOGN pass. Blocks first to last of wavefront w are (I, w - I).
+typedef struct{
+	void* s; /*The statenn array.*/
+	ssize_t start, end, tile, w, first;
+} k8_nlogn_pass;
+
+#define K8_NLOGN_BLOCK_BODY(func, nn, nnn, p, I, iscopy)\
+{\
+	state##nn* const k8s = (state##nn*)(p)->s;\
+	const ssize_t k8I = (ssize_t)(I), k8J = (p)->w - k8I;\
+	const ssize_t i0 = (p)->start + k8I * (p)->tile;\
+	const ssize_t i1 = i0 + (p)->tile < (p)->end ? i0 + (p)->tile : (p)->end;\
+	const ssize_t j0 = (p)->start + k8J * (p)->tile;\
+	const ssize_t j1 = j0 + (p)->tile < (p)->end ? j0 + (p)->tile : (p)->end;\
+	for(ssize_t ii = i0; ii < i1; ii++){\
+		state##nnn current_b;\
+		current_b.state##nn##s[0] = k8s[ii];\
+		for(ssize_t j = (k8I == k8J) ? ii+1 : j0; j < j1; j++)\
+		{\
+			current_b.state##nn##s[1] = k8s[j];\
+			K8_MULTIPLEX_NLOGN_CALLP(func, iscopy)\
+			k8s[j] = current_b.state##nn##s[1];\
+		}\
+		/*Write back elem i*/\
+		k8s[ii] = current_b.state##nn##s[0];\
+	}\
+}
+
+#define K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, k8_nlogn_pass*, a->first, 1, K8_NLOGN_BLOCK_BODY(func, nn, nnn, a, i, iscopy))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_WILLNEED)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
 	K8_STATIC_ASSERT(nnn == (nn+1));\
-	for(ssize_t i = start; i < end - 1; i++){\
-		state##nnn current_b;\
-		current_b.state##nn##s[0] = a->state##nn##s[i];\
-		for(ssize_t j = i+1; j < end; j++)\
-		{\
-			current_b.state##nn##s[1] = a->state##nn##s[j];\
-			K8_MULTIPLEX_NLOGN_CALLP(func, iscopy)\
-			a->state##nn##s[j] = current_b.state##nn##s[1];\
+	const ssize_t k8tile = K8_NLOGN_TILE(nn);\
+	const ssize_t k8tiles = ((end)-(start) + k8tile - 1) / k8tile;\
+	K8_PARREGION(alias)\
+	{\
+		for(ssize_t k8w = 0; k8w < 2*k8tiles - 1; k8w++){\
+			const ssize_t k8first = k8w < k8tiles ? 0 : k8w - (k8tiles - 1);\
+			const ssize_t k8last = k8w / 2;\
+			k8_nlogn_pass k8p = {a->state##nn##s, start, end, k8tile, k8w, k8first};\
+			K8_PARREGION_FOR(alias, name, &k8p, k8last - k8first + 1)\
+			for(ssize_t I = k8first; I <= k8last; I++)\
+				K8_NLOGN_BLOCK_BODY(func, nn, nnn, (&k8p), I, iscopy)\
 		}\
-		/*Write back elem i*/\
-		a->state##nn##s[i] = current_b.state##nn##s[0];\
 	}\
+	K8_PROFILE_END(K8_NLOGN_PAIRS(start, end), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn))\
 }
+
+#define K8_MULTIPLEX_NLOGN_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, PARALLEL)
+
 #define K8_MULTIPLEX_NLOGN(name, func, nn, nnn, nm, iscopy)\
 K8_MULTIPLEX_NLOGN_PARTIAL(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
 
+#define K8_MULTIPLEX_NLOGN_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, SUPARA)
 
-//NLOGN but parallel, the i element is considered "read only"
-//This is useful in situations where you want NLOGN functionality, but you dont want to modify i element.
-//Simd variant.
-#define K8_MULTIPLEX_NLOGNRO_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+#define K8_MULTIPLEX_NLOGN_SUPARA(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_NLOGN_PARTIAL_SUPARA(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+//Same tiles, run one after another.
+#define K8_MULTIPLEX_NLOGN_PARTIAL_NP(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGN_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, NOPARALLEL)
+
+#define K8_MULTIPLEX_NLOGN_NP(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_NLOGN_PARTIAL_NP(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+//Pair pointer variant, on the same wavefronts. func gets element i, then element j.
+#define K8_NLOGN_PAIR_BLOCK_BODY(func, nn, p, I)\
+{\
+	state##nn* const k8s = (state##nn*)(p)->s;\
+	const ssize_t k8I = (ssize_t)(I), k8J = (p)->w - k8I;\
+	const ssize_t i0 = (p)->start + k8I * (p)->tile;\
+	const ssize_t i1 = i0 + (p)->tile < (p)->end ? i0 + (p)->tile : (p)->end;\
+	const ssize_t j0 = (p)->start + k8J * (p)->tile;\
+	const ssize_t j1 = j0 + (p)->tile < (p)->end ? j0 + (p)->tile : (p)->end;\
+	for(ssize_t ii = i0; ii < i1; ii++)\
+		for(ssize_t j = (k8I == k8J) ? ii+1 : j0; j < j1; j++)\
+			func(k8s + ii, k8s + j);\
+}
+
+#define K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)\
+K8_PARFOR_RANGEFN(name, k8_nlogn_pass*, a->first, 1, K8_NLOGN_PAIR_BLOCK_BODY(func, nn, a, i))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_WILLNEED)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	const ssize_t k8tile = K8_NLOGN_TILE(nn);\
+	const ssize_t k8tiles = ((end)-(start) + k8tile - 1) / k8tile;\
+	K8_PARREGION(alias)\
+	{\
+		for(ssize_t k8w = 0; k8w < 2*k8tiles - 1; k8w++){\
+			const ssize_t k8first = k8w < k8tiles ? 0 : k8w - (k8tiles - 1);\
+			const ssize_t k8last = k8w / 2;\
+			k8_nlogn_pass k8p = {a->state##nn##s, start, end, k8tile, k8w, k8first};\
+			K8_PARREGION_FOR(alias, name, &k8p, k8last - k8first + 1)\
+			for(ssize_t I = k8first; I <= k8last; I++)\
+				K8_NLOGN_PAIR_BLOCK_BODY(func, nn, (&k8p), I)\
+		}\
+	}\
+	K8_PROFILE_END(K8_NLOGN_PAIRS(start, end), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn))\
+}
+
+#define K8_MULTIPLEX_NLOGN_PAIR_PARTIAL(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, PARALLEL)
+
+#define K8_MULTIPLEX_NLOGN_PAIR(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_SUPARA(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, SUPARA)
+
+#define K8_MULTIPLEX_NLOGN_PAIR_SUPARA(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_NP(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, NOPARALLEL)
+
+#define K8_MULTIPLEX_NLOGN_PAIR_NP(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGN_PAIR_PARTIAL_NP(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+
+/*
+NLOGN but parallel, the i element is considered "read only"
+This is useful in situations where you want NLOGN functionality, but you dont want to modify i element.
+Element j gets every i < j in order, and the i it gets is already final- so element j depends on all of the
+elements before it, and only the j's for the same i can run at once.
+
+The elements are cut into tiles of "tile" (a constant) elements. Once a tile is final, every j after it takes the whole tile
+(sweeping the tile's i's, which stay in L1), in chunks of about K8_NLOGNRO_CHUNK pairs.
+Chunk 0 is the next tile, and whoever takes it also finishes the next tile's own triangle,
+so a tile costs one barrier and everything runs inside of one parallel region.
+K8_MULTIPLEX_NLOGNRO uses tiles of 1 (an i at a time), the BLOCKED variants use K8_NLOGN_TILE(nn).
+*/
+#ifndef K8_NLOGNRO_CHUNK
+#define K8_NLOGNRO_CHUNK (1<<14)
+#endif
+
+//One tile of an NLOGNRO pass. Elements i0 to i0 + tile are final, chunk c > 0 is "per" j's after the next tile.
+typedef struct{
+	void* s; /*The statenn array.*/
+	ssize_t end, i0, per;
+} k8_nlognro_pass;
+
+//Pass i0 to i1 (in order) to element j.
+#define K8_NLOGNRO_APPLY(func, nn, nnn, k8s, j, i0, i1, iscopy)\
+{\
+	state##nnn current_b;\
+	current_b.state##nn##s[1] = k8s[j];\
+	for(ssize_t ii = (i0); ii < (i1); ii++){\
+		current_b.state##nn##s[0] = k8s[ii];\
+		K8_MULTIPLEX_NLOGN_CALLP(func, iscopy)\
+	}\
+	k8s[j] = current_b.state##nn##s[1];\
+}
+
+//All of the pairs within lo to hi- afterwards, they are final.
+#define K8_NLOGNRO_TRIANGLE(func, nn, nnn, k8s, lo, hi, iscopy)\
+	for(ssize_t jj = (lo) + 1; jj < (hi); jj++)\
+		K8_NLOGNRO_APPLY(func, nn, nnn, k8s, jj, lo, jj, iscopy)
+
+//tile is a constant, so that the compiler can unroll (or, for 1, drop) the loop over the tile.
+#define K8_NLOGNRO_CHUNK_BODY(func, nn, nnn, p, c, tile, iscopy)\
+{\
+	state##nn* const k8s = (state##nn*)(p)->s;\
+	const ssize_t k8i1 = (p)->i0 + (tile);\
+	const ssize_t k8next = k8i1 + (tile) < (p)->end ? k8i1 + (tile) : (p)->end;\
+	const ssize_t j0 = (c) ? k8next + ((ssize_t)(c) - 1) * (p)->per : k8i1;\
+	const ssize_t j1 = (c) ? (j0 + (p)->per < (p)->end ? j0 + (p)->per : (p)->end) : k8next;\
+	for(ssize_t j = j0; j < j1; j++)\
+		K8_NLOGNRO_APPLY(func, nn, nnn, k8s, j, (p)->i0, (p)->i0 + (tile), iscopy)\
+	if(!(c)) K8_NLOGNRO_TRIANGLE(func, nn, nnn, k8s, k8i1, k8next, iscopy)\
+}
+
+#define K8_MULTIPLEX_NLOGNRO_TILED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, tile, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, k8_nlognro_pass*, 0, 1, K8_NLOGNRO_CHUNK_BODY(func, nn, nnn, a, i, tile, iscopy))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_WILLNEED)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
 	K8_STATIC_ASSERT(nnn == (nn+1));\
-	for(ssize_t i = start; i < end - 1; i++){\
-		state##nn shared = a->state##nn##s[i];\
-		PRAGMA_##alias\
-		for(ssize_t j = i+1; j < end; j++)\
-		{\
-			state##nnn current_b;\
-			current_b.state##nn##s[0] = shared;\
-			current_b.state##nn##s[1] = a->state##nn##s[j];\
-			K8_MULTIPLEX_NLOGN_CALLP(func, iscopy)\
-			a->state##nn##s[j] = current_b.state##nn##s[1];\
+	K8_STATIC_ASSERT(tile > 0);\
+	const ssize_t k8tile = (tile);\
+	const ssize_t k8tiles = ((end)-(start) + k8tile - 1) / k8tile;\
+	const ssize_t k8per = K8_NLOGNRO_CHUNK / k8tile > 0 ? K8_NLOGNRO_CHUNK / k8tile : 1;\
+	K8_NLOGNRO_TRIANGLE(func, nn, nnn, a->state##nn##s, (start), ((start) + k8tile < (end) ? (start) + k8tile : (end)), iscopy)\
+	K8_PARREGION(alias)\
+	{\
+		for(ssize_t k8t = 0; k8t < k8tiles - 1; k8t++){\
+			const ssize_t k8i0 = (start) + k8t * k8tile;\
+			const ssize_t k8rest = (end) - (k8i0 + 2*k8tile);\
+			k8_nlognro_pass k8p = {a->state##nn##s, end, k8i0, k8per};\
+			const ssize_t k8chunks = 1 + (k8rest > 0 ? (k8rest + k8per - 1) / k8per : 0);\
+			K8_PARREGION_FOR(alias, name, &k8p, k8chunks)\
+			for(ssize_t c = 0; c < k8chunks; c++)\
+				K8_NLOGNRO_CHUNK_BODY(func, nn, nnn, (&k8p), c, tile, iscopy)\
+		}\
+	}\
+	K8_PROFILE_END(K8_NLOGN_PAIRS(start, end), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn), K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn))\
+}
+
+#define K8_MULTIPLEX_NLOGNRO_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_MULTIPLEX_NLOGNRO_TILED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, 1, iscopy, alias)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, alias)\
+K8_MULTIPLEX_NLOGNRO_TILED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, K8_NLOGN_TILE(nn), iscopy, alias)
+
+//Pair pointer variants, on the same tiles. func gets element i (which it must not write to), then element j.
+#define K8_NLOGNRO_PAIR_APPLY(func, k8s, j, i0, i1)\
+	for(ssize_t ii = (i0); ii < (i1); ii++)\
+		func(k8s + ii, k8s + (j));
+
+#define K8_NLOGNRO_PAIR_TRIANGLE(func, k8s, lo, hi)\
+	for(ssize_t jj = (lo) + 1; jj < (hi); jj++)\
+		K8_NLOGNRO_PAIR_APPLY(func, k8s, jj, lo, jj)
+
+#define K8_NLOGNRO_PAIR_CHUNK_BODY(func, nn, p, c, tile)\
+{\
+	state##nn* const k8s = (state##nn*)(p)->s;\
+	const ssize_t k8i1 = (p)->i0 + (tile);\
+	const ssize_t k8next = k8i1 + (tile) < (p)->end ? k8i1 + (tile) : (p)->end;\
+	const ssize_t j0 = (c) ? k8next + ((ssize_t)(c) - 1) * (p)->per : k8i1;\
+	const ssize_t j1 = (c) ? (j0 + (p)->per < (p)->end ? j0 + (p)->per : (p)->end) : k8next;\
+	for(ssize_t j = j0; j < j1; j++)\
+		K8_NLOGNRO_PAIR_APPLY(func, k8s, j, (p)->i0, (p)->i0 + (tile))\
+	if(!(c)) K8_NLOGNRO_PAIR_TRIANGLE(func, k8s, k8i1, k8next)\
+}
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_TILED_PARTIAL_ALIAS(name, func, nn, nm, start, end, tile, alias)\
+K8_PARFOR_RANGEFN(name, k8_nlognro_pass*, 0, 1, K8_NLOGNRO_PAIR_CHUNK_BODY(func, nn, a, i, tile))\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##nn##s + (start), ((end)-(start))*STATE_SIZE(nn), K8_ADV_WILLNEED)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)/STATE_SIZE(nn)));\
+	K8_STATIC_ASSERT(tile > 0);\
+	const ssize_t k8tile = (tile);\
+	const ssize_t k8tiles = ((end)-(start) + k8tile - 1) / k8tile;\
+	const ssize_t k8per = K8_NLOGNRO_CHUNK / k8tile > 0 ? K8_NLOGNRO_CHUNK / k8tile : 1;\
+	K8_NLOGNRO_PAIR_TRIANGLE(func, a->state##nn##s, (start), ((start) + k8tile < (end) ? (start) + k8tile : (end)))\
+	K8_PARREGION(alias)\
+	{\
+		for(ssize_t k8t = 0; k8t < k8tiles - 1; k8t++){\
+			const ssize_t k8i0 = (start) + k8t * k8tile;\
+			const ssize_t k8rest = (end) - (k8i0 + 2*k8tile);\
+			k8_nlognro_pass k8p = {a->state##nn##s, end, k8i0, k8per};\
+			const ssize_t k8chunks = 1 + (k8rest > 0 ? (k8rest + k8per - 1) / k8per : 0);\
+			K8_PARREGION_FOR(alias, name, &k8p, k8chunks)\
+			for(ssize_t c = 0; c < k8chunks; c++)\
+				K8_NLOGNRO_PAIR_CHUNK_BODY(func, nn, (&k8p), c, tile)\
 		}\
 	}\
+	K8_PROFILE_END(K8_NLOGN_PAIRS(start, end), 2*K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn), K8_NLOGN_PAIRS(start, end)*STATE_SIZE(nn))\
 }
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)\
+K8_MULTIPLEX_NLOGNRO_PAIR_TILED_PARTIAL_ALIAS(name, func, nn, nm, start, end, 1, alias)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, alias)\
+K8_MULTIPLEX_NLOGNRO_PAIR_TILED_PARTIAL_ALIAS(name, func, nn, nm, start, end, K8_NLOGN_TILE(nn), alias)
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, PARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_SUPARA(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, SUPARA)
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_SUPARA(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_NP(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, NOPARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_PAIR_NP(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_PAIR_PARTIAL_NP(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, PARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_SUPARA(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, SUPARA)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_SUPARA(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_SUPARA(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_NP(name, func, nn, nm, start, end)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_ALIAS(name, func, nn, nm, start, end, NOPARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_NP(name, func, nn, nm)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PAIR_PARTIAL_NP(name, func, nn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)))
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, PARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_SUPARA(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, SUPARA)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_SUPARA(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_SUPARA(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_NP(name, func, nn, nnn, nm, start, end, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, NOPARALLEL)
+
+#define K8_MULTIPLEX_NLOGNRO_BLOCKED_NP(name, func, nn, nnn, nm, iscopy)\
+K8_MULTIPLEX_NLOGNRO_BLOCKED_PARTIAL_NP(name, func, nn, nnn, nm, 0, (STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
 #define K8_MULTIPLEX_NLOGNRO_PARTIAL_NP(name, func, nn, nnn, nm, start, end, iscopy)\
 K8_MULTIPLEX_NLOGNRO_PARTIAL_ALIAS(name, func, nn, nnn, nm, start, end, iscopy, NOPARALLEL)
 
@@ -1739,18 +4790,26 @@ Multiplex extracting arbitrary data
 Extract "nproc" bytes and put it in a state##nn, 
 which is then passed to func.
 */
+#define K8_MULTIPLEX_DE_BODY(func, nproc, nn, iscopy)\
+	{\
+		state##nn data;\
+		memcpy(data.state, a->state+i, nproc);\
+		K8_MULTIPLEX_DE_CALLP(func, iscopy)\
+		memcpy(a->state+i, data.state, nproc);\
+	}
+
 #define K8_MULTIPLEX_DATA_EXTRACTION_PARTIAL_ALIAS(name, func, nproc, nn, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, nproc, K8_MULTIPLEX_DE_BODY(func, nproc, nn, iscopy))\
 static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state + (start), ((end)-(start))+nproc-1, K8_ADV_SEQUENTIAL)\
 	K8_STATIC_ASSERT(start >= 0);\
 	K8_STATIC_ASSERT(start <= end);\
 	K8_STATIC_ASSERT(end <= (STATE_SIZE(nm)-nproc+1) );\
-	PRAGMA_##alias\
-	for(ssize_t i = start; i < end; i += nproc){\
-		state##nn data;\
-		memcpy(data.state, a->state+i, nproc);\
-		K8_MULTIPLEX_DE_CALLP(func, iscopy)\
-		memcpy(a->state+i, data.state, nproc);\
-	}\
+	K8_PARFOR(alias, name, a, ((end)-(start)+(nproc)-1)/(nproc))\
+	for(ssize_t i = start; i < end; i += nproc)\
+		K8_MULTIPLEX_DE_BODY(func, nproc, nn, iscopy)\
+	K8_PROFILE_END(((end)-(start)+(nproc)-1)/(nproc), (end)-(start), (end)-(start))\
 }
 
 /*Partials*/
@@ -1779,6 +4838,469 @@ K8_MULTIPLEX_DATA_EXTRACTION_PARTIAL_SIMD(name, func, nproc, nn, nm, 0, STATE_SI
 #define K8_MULTIPLEX_DATA_EXTRACTION_NP(name, func, nproc, nn, nm, iscopy)\
 K8_MULTIPLEX_DATA_EXTRACTION_PARTIAL_NP(name, func, nproc, nn, nm, 0, STATE_SIZE(nm)-nproc+1, iscopy)
 
+/*
+Tabulation.
+Every kernel can be replaced with a lookup table. For state1 and state2 kernels the table is small enough
+to actually do it- 256 bytes, or 128 kilobytes.
+
+K8_TABULATE1(name, func, iscopy) declares name##_table, a state1[256] which is filled in with func's
+output for every input before main runs, and the kernel name, which is func as a table lookup.
+K8_TABULATE2(name, func, iscopy) does the same for a state2 kernel, with 65536 entries.
+name##_dump(FILE*) prints the table as a C initializer. Generate a header with it and
+K8_TABLE1/K8_TABLE2 will turn the constant array into a kernel, so the table is built at
+compile time and lives in .rodata.
+
+Chains of expensive byte kernels collapse into a single lookup:
+	K8_CHAINP(k_both, k_expensive1, k_expensive2, 1)
+	K8_TABULATE1(k_both_t, k_both, 0)
+	K8_MULTIPLEX_TABLE1(k_both_mt20, k_both_t_table, 20)
+
+Without GCC or clang there is no way to run code before main, call name##_tabulate() yourself.
+*/
+#if defined(__GNUC__)
+#define K8_CONSTRUCTOR __attribute__((constructor))
+#else
+#define K8_CONSTRUCTOR /*a comment*/
+#endif
+
+#define K8_TABULATE_CALL(iscopy, func) K8_TABULATE_CALL_##iscopy(func)
+#define K8_TABULATE_CALL_1(func) s = func(s);
+#define K8_TABULATE_CALL_0(func) func(&s);
+
+#define K8_TABULATE_N(name, func, n, bits, iscopy)\
+static state##n name##_table[(size_t)1<<bits];\
+static K8_CONSTRUCTOR void name##_tabulate(){\
+	for(size_t i = 0; i < ((size_t)1<<bits); i++){\
+		state##n s = to_state##n(i);\
+		K8_TABULATE_CALL(iscopy, func)\
+		name##_table[i] = s;\
+	}\
+}\
+static inline void name##_dump(FILE* f){\
+	fprintf(f, "static const state" #n " " #name "_table[%zu] = {\n", (size_t)1<<bits);\
+	for(size_t i = 0; i < ((size_t)1<<bits); i++){\
+		fputs("{{", f);\
+		for(size_t j = 0; j < STATE_SIZE(n); j++)\
+			fprintf(f, j ? ", %u" : "%u", (unsigned)name##_table[i].state[j]);\
+		fputs((i % 8 == 7) ? "}},\n" : "}}, ", f);\
+	}\
+	fputs("};\n", f);\
+}\
+K8_TABLE_N(name, name##_table, n)
+
+//Turn a table (of any storage class) into a kernel.
+#define K8_TABLE_N(name, table, n)\
+static inline void name(state##n *c){\
+	*c = table[from_state##n(*c)];\
+}
+
+#define K8_TABULATE1(name, func, iscopy) K8_TABULATE_N(name, func, 1, 8, iscopy)
+#define K8_TABULATE2(name, func, iscopy) K8_TABULATE_N(name, func, 2, 16, iscopy)
+#define K8_TABLE1(name, table) K8_TABLE_N(name, table, 1)
+#define K8_TABLE2(name, table) K8_TABLE_N(name, table, 2)
+
+/*
+Apply a table to every state1 (or state2) of a large state.
+This is a plain gather loop, which is what the compilers know how to vectorize.
+*/
+#define K8_MULTIPLEX_TABLE_PARTIAL_ALIAS(name, table, n, nm, start, end, alias)\
+K8_PARFOR_RANGEFN(name, state##nm*, start, 1, a->state##n##s[i] = table[from_state##n(a->state##n##s[i])];)\
+static inline void name(state##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_ADVISE_RANGE(a->state##n##s + (start), ((end)-(start))*STATE_SIZE(n), K8_ADV_SEQUENTIAL)\
+	K8_STATIC_ASSERT(start >= 0);\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(n)) );\
+	K8_PARFOR(alias, name, a, (end)-(start))\
+	for(size_t i = start; i < end; i++)\
+		a->state##n##s[i] = table[from_state##n(a->state##n##s[i])];\
+	K8_PROFILE_END(end-start, (end-start)*STATE_SIZE(n), (end-start)*STATE_SIZE(n))\
+}
+
+#define K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(name, table, nm, start, end, alias)\
+K8_MULTIPLEX_TABLE_PARTIAL_ALIAS(name, table, 1, nm, start, end, alias)
+#define K8_MULTIPLEX_TABLE2_PARTIAL_ALIAS(name, table, nm, start, end, alias)\
+K8_MULTIPLEX_TABLE_PARTIAL_ALIAS(name, table, 2, nm, start, end, alias)
+
+#define K8_MULTIPLEX_TABLE1(name, table, nm)\
+K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(1)), PARALLEL)
+#define K8_MULTIPLEX_TABLE1_SUPARA(name, table, nm)\
+K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(1)), SUPARA)
+#define K8_MULTIPLEX_TABLE1_SIMD(name, table, nm)\
+K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(1)), SIMD)
+#define K8_MULTIPLEX_TABLE1_NP(name, table, nm)\
+K8_MULTIPLEX_TABLE1_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(1)), NOPARALLEL)
+
+#define K8_MULTIPLEX_TABLE2(name, table, nm)\
+K8_MULTIPLEX_TABLE2_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(2)), PARALLEL)
+#define K8_MULTIPLEX_TABLE2_SUPARA(name, table, nm)\
+K8_MULTIPLEX_TABLE2_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(2)), SUPARA)
+#define K8_MULTIPLEX_TABLE2_SIMD(name, table, nm)\
+K8_MULTIPLEX_TABLE2_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(2)), SIMD)
+#define K8_MULTIPLEX_TABLE2_NP(name, table, nm)\
+K8_MULTIPLEX_TABLE2_PARTIAL_ALIAS(name, table, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(2)), NOPARALLEL)
+
+/*
+Memoization.
+Kernels are pure, so their results can be cached. When the same inputs come up over and over
+(and the kernel is expensive- think is_prime) a cache in front of the kernel pays for itself.
+Tables are better when the domain is small, this is for state3 and state4.
+
+K8_MEMOIZE(name, func, n, shards, slots, policy, iscopy) makes the kernel name, which is func
+behind a cache of 2^shards shards, each holding 2^slots entries. shards + slots must be at least 1.
+Each entry is direct mapped, and has its own sequence lock, so there are no locks to wait on:
+a reader that finds an entry being written just misses, a writer that finds it being written
+just doesn't insert.
+Policies:
+	K8_MEMO_OVERWRITE	A new result replaces whatever was in its entry.
+	K8_MEMO_KEEP		Entries are written once. The first inputs seen stay cached forever.
+
+name##_stats(&stats) sums the counters of every shard, name##_report(FILE*) prints them shard by shard.
+name##_clear() empties the cache, don't call it while the kernel is running.
+
+	K8_MEMOIZE(is_prime_memo, is_prime, 3, 4, 12, K8_MEMO_OVERWRITE, 0)
+	K8_MULTIPLEX(is_prime_memo_mtp20, is_prime_memo, 3, 20, 0)
+*/
+#define K8_MEMO_OVERWRITE 0
+#define K8_MEMO_KEEP 1
+
+typedef struct{
+	uint32_t seq; /*Odd while being written, zero while empty.*/
+	uint64_t key;
+	uint64_t val;
+} k8_memo_slot;
+
+//A cache line each. K8_ALIGN is off (K8_NO_ALIGN), so the alignment is spelled out here.
+typedef struct{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;
+	char pad[64 - 3 * sizeof(uint64_t)];
+} __attribute__((aligned(64))) k8_memo_shard;
+
+typedef struct{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;
+} k8_memo_stats;
+
+static inline uint64_t k8_memo_hash(uint64_t key){
+	key ^= key >> 33;
+	return (key + 1) * 0x9E3779B97F4A7C15ull;
+}
+
+static inline int k8_memo_get(k8_memo_slot* s, uint64_t key, uint64_t* val){
+	const uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+	if(seq == 0 || (seq & 1)) return 0;
+	const uint64_t k = __atomic_load_n(&s->key, __ATOMIC_RELAXED);
+	const uint64_t v = __atomic_load_n(&s->val, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq || k != key) return 0;
+	*val = v;
+	return 1;
+}
+
+static inline int k8_memo_put(k8_memo_slot* s, uint64_t key, uint64_t val, int policy){
+	uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	if(seq & 1) return 0;
+	if(policy == K8_MEMO_KEEP && seq != 0) return 0;
+	if(!__atomic_compare_exchange_n(&s->seq, &seq, seq + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return 0;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&s->key, key, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->val, val, __ATOMIC_RELAXED);
+	/*Skip zero when the counter wraps, zero means empty.*/
+	__atomic_store_n(&s->seq, seq + 2 ? seq + 2 : 2, __ATOMIC_RELEASE);
+	return 1;
+}
+
+#define K8_MEMO_CALL(iscopy, func) K8_MEMO_CALL_##iscopy(func)
+#define K8_MEMO_CALL_1(func) *c = func(*c);
+#define K8_MEMO_CALL_0(func) func(c);
+
+#define K8_MEMOIZE(name, func, n, shards, slots, policy, iscopy)\
+static k8_memo_shard name##_shards[(size_t)1<<(shards)];\
+static k8_memo_slot name##_slots[(size_t)1<<((shards)+(slots))];\
+static inline void name(state##n *c){\
+	K8_STATIC_ASSERT(STATE_SIZE(n) <= 8);\
+	K8_STATIC_ASSERT((shards) + (slots) >= 1);\
+	const uint64_t key = from_state##n(*c);\
+	const size_t idx = k8_memo_hash(key) >> (64 - ((shards) + (slots)));\
+	k8_memo_shard* shard = name##_shards + (idx >> (slots));\
+	uint64_t val;\
+	if(k8_memo_get(name##_slots + idx, key, &val)){\
+		__atomic_fetch_add(&shard->hits, 1, __ATOMIC_RELAXED);\
+		*c = to_state##n(val);\
+		return;\
+	}\
+	K8_MEMO_CALL(iscopy, func)\
+	__atomic_fetch_add(&shard->misses, 1, __ATOMIC_RELAXED);\
+	if(k8_memo_put(name##_slots + idx, key, from_state##n(*c), policy))\
+		__atomic_fetch_add(&shard->inserts, 1, __ATOMIC_RELAXED);\
+}\
+static inline void name##_stats(k8_memo_stats* st){\
+	st->hits = 0; st->misses = 0; st->inserts = 0;\
+	for(size_t i = 0; i < ((size_t)1<<(shards)); i++){\
+		st->hits += __atomic_load_n(&name##_shards[i].hits, __ATOMIC_RELAXED);\
+		st->misses += __atomic_load_n(&name##_shards[i].misses, __ATOMIC_RELAXED);\
+		st->inserts += __atomic_load_n(&name##_shards[i].inserts, __ATOMIC_RELAXED);\
+	}\
+}\
+static inline void name##_report(FILE* f){\
+	k8_memo_stats st;\
+	name##_stats(&st);\
+	fprintf(f, "K8_MEMOIZE " #name ": %llu hits, %llu misses, %llu inserts, hit rate %.4f\n",\
+		(unsigned long long)st.hits, (unsigned long long)st.misses, (unsigned long long)st.inserts,\
+		(st.hits + st.misses) ? (double)st.hits / (double)(st.hits + st.misses) : 0.0);\
+	for(size_t i = 0; i < ((size_t)1<<(shards)); i++)\
+		fprintf(f, "\tshard %zu: %llu hits, %llu misses, %llu inserts\n", i,\
+			(unsigned long long)name##_shards[i].hits, (unsigned long long)name##_shards[i].misses,\
+			(unsigned long long)name##_shards[i].inserts);\
+}\
+static inline void name##_clear(){\
+	memset(name##_slots, 0, sizeof(name##_slots));\
+	memset(name##_shards, 0, sizeof(name##_shards));\
+}
+
+/*
+Paged states.
+A paged state is a state##nm stored as 2^(nm-np) separate state##np pages, found through a page table.
+Nothing has to be virtually contiguous, and pages are only allocated (zeroed) when they are first touched,
+so a state35 that is mostly untouched costs a page table and a few pages.
+
+K8_PAGED_STATE(np, nm) declares the type paged##np##_##nm and its functions:
+	paged##np##_##nm##_new()			Allocate the page table. No pages yet. NULL if out of memory.
+	paged##np##_##nm##_free(p)			Free every page and the table.
+	paged##np##_##nm##_page(p, pg)		Page pg, allocated on first use. Safe to call from many threads.
+	paged##np##_##nm##_peek(p, pg)		Page pg, or NULL if it was never touched.
+	paged##np##_##nm##_free_page(p, pg)	Give a page back. It reads as zeroes the next time it is touched.
+	paged##np##_##nm##_resident(p)		How many pages are allocated.
+
+k_pgat and k_pgoff are k_pat and k_poff for paged states, and are masked the same way:
+	k_pgat(p, i, 3, 20, 35) = to_state3(7);
+
+K8_PAGED_MULTIPLEX(name, func, nn, np, nm, iscopy) and friends walk the state page by page,
+and K8_PAGED_MULTIPLEX_INDEXED gives the kernel the index into the whole paged state, not the page.
+K8_PAGED_PAGEWISE runs any state##np kernel (including another multiplexer) on every page.
+*/
+#define K8_PAGES(np, nm) ((size_t)1<<(nm-np))
+#define K8_PAGE_ELEMS(nn, np) ((size_t)(STATE_SIZE(np)/STATE_SIZE(nn)))
+
+#define K8_PAGED_STATE(np, nm)\
+typedef struct{\
+	state##np** pages;\
+} paged##np##_##nm;\
+static inline paged##np##_##nm* paged##np##_##nm##_new(){\
+	K8_STATIC_ASSERT(np <= nm);\
+	paged##np##_##nm* p = malloc(sizeof(paged##np##_##nm));\
+	if(!p) return NULL;\
+	p->pages = calloc(K8_PAGES(np, nm), sizeof(state##np*));\
+	if(!p->pages) {free(p); return NULL;}\
+	return p;\
+}\
+static inline state##np* paged##np##_##nm##_peek(paged##np##_##nm* p, size_t pg){\
+	return __atomic_load_n(p->pages + (pg & (K8_PAGES(np, nm) - 1)), __ATOMIC_ACQUIRE);\
+}\
+static inline state##np* paged##np##_##nm##_page(paged##np##_##nm* p, size_t pg){\
+	state##np** slot = p->pages + (pg & (K8_PAGES(np, nm) - 1));\
+	state##np* page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);\
+	if(page) return page;\
+	state##np* fresh = calloc(1, sizeof(state##np));\
+	if(!fresh) {fputs("K8_PAGED_STATE: out of memory allocating a page.\n", stderr); abort();}\
+	/*Somebody else may have allocated it first. Theirs wins.*/\
+	if(__atomic_compare_exchange_n(slot, &page, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return fresh;\
+	free(fresh);\
+	return page;\
+}\
+static inline void paged##np##_##nm##_free_page(paged##np##_##nm* p, size_t pg){\
+	free(__atomic_exchange_n(p->pages + (pg & (K8_PAGES(np, nm) - 1)), NULL, __ATOMIC_ACQ_REL));\
+}\
+static inline size_t paged##np##_##nm##_resident(paged##np##_##nm* p){\
+	size_t count = 0;\
+	for(size_t pg = 0; pg < K8_PAGES(np, nm); pg++)\
+		count += paged##np##_##nm##_peek(p, pg) != NULL;\
+	return count;\
+}\
+static inline void paged##np##_##nm##_free(paged##np##_##nm* p){\
+	if(!p) return;\
+	for(size_t pg = 0; pg < K8_PAGES(np, nm); pg++)\
+		free(p->pages[pg]);\
+	free(p->pages);\
+	free(p);\
+}
+
+#define k_pgoff(p, i, n, np, nm) (((state##n*)paged##np##_##nm##_page(p, (((size_t)(i)) & ACCESS_MASK(n, nm)) / K8_PAGE_ELEMS(n, np)))\
+	+ (((size_t)(i)) & ACCESS_MASK(n, np)))
+#define k_pgat(p, i, n, np, nm) (*k_pgoff(p, i, n, np, nm))
+
+#define K8_PAGED_CALLP(iscopy, func) K8_PAGED_CALLP_##iscopy(func)
+#define K8_PAGED_CALLP_1(func) page[i] = func(page[i]);
+#define K8_PAGED_CALLP_0(func) func(page + i);
+
+//Paged multiplexers run one parallel loop over chunks of K8_PAGED_CHUNK bytes, each inside a single page,
+//rather than a loop per page. SIMD goes on the loop inside a chunk.
+#ifndef K8_PAGED_CHUNK
+#define K8_PAGED_CHUNK ((size_t)1<<12)
+#endif
+#define K8_PAGED_CHUNK_ELEMS(nn, np) ((size_t)((STATE_SIZE(np) < K8_PAGED_CHUNK ? STATE_SIZE(np) :\
+	STATE_SIZE(nn) > K8_PAGED_CHUNK ? STATE_SIZE(nn) : K8_PAGED_CHUNK) / STATE_SIZE(nn)))
+#define K8_PAGED_CHUNKS(nn, np, start, end) (((end) + K8_PAGED_CHUNK_ELEMS(nn, np) - 1) / K8_PAGED_CHUNK_ELEMS(nn, np) - (start) / K8_PAGED_CHUNK_ELEMS(nn, np))
+#define K8_PAGED_OUTER_PARALLEL PARALLEL
+#define K8_PAGED_OUTER_SUPARA SUPARA
+#define K8_PAGED_OUTER_SIMD NOPARALLEL
+#define K8_PAGED_OUTER_NOPARALLEL NOPARALLEL
+#define K8_PAGED_INNER_PARALLEL /*a comment*/
+#define K8_PAGED_INNER_SUPARA /*a comment*/
+#define K8_PAGED_INNER_SIMD PRAGMA_SIMD
+#define K8_PAGED_INNER_NOPARALLEL /*a comment*/
+#define K8_PAGED_PARFOR(alias, name, arg, count) K8_PAGED_PARFOR_(K8_PAGED_OUTER_##alias, name, arg, count)
+#define K8_PAGED_PARFOR_(alias, name, arg, count) K8_PARFOR(alias, name, arg, count)
+
+//Elements of chunk c (counted across the whole paged state) that lie in start to end, as i within page,
+//whose first element is element k8base of the whole state.
+#define K8_PAGED_CHUNK_BODY(nn, np, nm, start, end, c, alias, ...)\
+	{\
+		const size_t k8c = (c);\
+		const size_t k8lo = k8c * K8_PAGED_CHUNK_ELEMS(nn, np) > (start) ? k8c * K8_PAGED_CHUNK_ELEMS(nn, np) : (start);\
+		const size_t k8hi = (k8c + 1) * K8_PAGED_CHUNK_ELEMS(nn, np) < (end) ? (k8c + 1) * K8_PAGED_CHUNK_ELEMS(nn, np) : (end);\
+		const size_t k8base = k8lo - k8lo % K8_PAGE_ELEMS(nn, np);\
+		state##nn* page = (state##nn*)paged##np##_##nm##_page(a, k8lo / K8_PAGE_ELEMS(nn, np));\
+		K8_PAGED_INNER_##alias\
+		for(size_t i = k8lo - k8base; i < k8hi - k8base; i++)\
+			__VA_ARGS__\
+	}
+
+//Elements start to end (counted across the whole paged state).
+#define K8_PAGED_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, np, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, paged##np##_##nm*, (start) / K8_PAGED_CHUNK_ELEMS(nn, np), 1,\
+	K8_PAGED_CHUNK_BODY(nn, np, nm, start, end, i, alias, K8_PAGED_CALLP(iscopy, func)))\
+static inline void name(paged##np##_##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)) );\
+	if((start) < (end)){\
+		K8_PAGED_PARFOR(alias, name, a, K8_PAGED_CHUNKS(nn, np, start, end))\
+		for(size_t c = (start) / K8_PAGED_CHUNK_ELEMS(nn, np); c < ((end) + K8_PAGED_CHUNK_ELEMS(nn, np) - 1) / K8_PAGED_CHUNK_ELEMS(nn, np); c++)\
+			K8_PAGED_CHUNK_BODY(nn, np, nm, start, end, c, alias, K8_PAGED_CALLP(iscopy, func))\
+	}\
+	K8_PROFILE_END((end)-(start), ((end)-(start))*STATE_SIZE(nn), ((end)-(start))*STATE_SIZE(nn))\
+}
+
+#define K8_PAGED_MULTIPLEX_PARTIAL(name, func, nn, np, nm, start, end, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, np, nm, start, end, iscopy, PARALLEL)
+#define K8_PAGED_MULTIPLEX_PARTIAL_SUPARA(name, func, nn, np, nm, start, end, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, np, nm, start, end, iscopy, SUPARA)
+#define K8_PAGED_MULTIPLEX_PARTIAL_SIMD(name, func, nn, np, nm, start, end, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, np, nm, start, end, iscopy, SIMD)
+#define K8_PAGED_MULTIPLEX_PARTIAL_NP(name, func, nn, np, nm, start, end, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_ALIAS(name, func, nn, np, nm, start, end, iscopy, NOPARALLEL)
+
+#define K8_PAGED_MULTIPLEX(name, func, nn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL(name, func, nn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_PAGED_MULTIPLEX_SUPARA(name, func, nn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_SUPARA(name, func, nn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_PAGED_MULTIPLEX_SIMD(name, func, nn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_SIMD(name, func, nn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+#define K8_PAGED_MULTIPLEX_NP(name, func, nn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_PARTIAL_NP(name, func, nn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy)
+
+#define K8_PAGED_ICALLP(iscopy, func) K8_PAGED_ICALLP_##iscopy(func)
+#define K8_PAGED_ICALLP_1(func) current_indexed = func(current_indexed);
+#define K8_PAGED_ICALLP_0(func) func(&current_indexed);
+
+//The index handed to the kernel is the element's index in the whole paged state.
+#define K8_PAGED_INDEXED_BODY(func, nn, nnn, iscopy)\
+		{\
+			state##nnn current_indexed;\
+			const uint32_t ind32 = k8base + i;\
+			memset(current_indexed.state, 0, STATE_SIZE(nn));\
+			memcpy(current_indexed.state, &ind32, STATE_SIZE(nn) < 4 ? STATE_SIZE(nn) : 4);\
+			current_indexed.state##nn##s[1] = page[i];\
+			K8_PAGED_ICALLP(iscopy, func)\
+			page[i] = current_indexed.state##nn##s[1];\
+		}
+
+#define K8_PAGED_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, np, nm, start, end, iscopy, alias)\
+K8_PARFOR_RANGEFN(name, paged##np##_##nm*, (start) / K8_PAGED_CHUNK_ELEMS(nn, np), 1,\
+	K8_PAGED_CHUNK_BODY(nn, np, nm, start, end, i, alias, K8_PAGED_INDEXED_BODY(func, nn, nnn, iscopy)))\
+static inline void name(paged##np##_##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	K8_STATIC_ASSERT(start <= end);\
+	K8_STATIC_ASSERT(end <= (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)) );\
+	K8_STATIC_ASSERT(nnn == (nn + 1));\
+	if((start) < (end)){\
+		K8_PAGED_PARFOR(alias, name, a, K8_PAGED_CHUNKS(nn, np, start, end))\
+		for(size_t c = (start) / K8_PAGED_CHUNK_ELEMS(nn, np); c < ((end) + K8_PAGED_CHUNK_ELEMS(nn, np) - 1) / K8_PAGED_CHUNK_ELEMS(nn, np); c++)\
+			K8_PAGED_CHUNK_BODY(nn, np, nm, start, end, c, alias, K8_PAGED_INDEXED_BODY(func, nn, nnn, iscopy))\
+	}\
+	K8_PROFILE_END((end)-(start), ((end)-(start))*STATE_SIZE(nn), ((end)-(start))*STATE_SIZE(nn))\
+}
+
+#define K8_PAGED_MULTIPLEX_INDEXED(name, func, nn, nnn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, PARALLEL)
+#define K8_PAGED_MULTIPLEX_INDEXED_SUPARA(name, func, nn, nnn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, SUPARA)
+#define K8_PAGED_MULTIPLEX_INDEXED_SIMD(name, func, nn, nnn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, SIMD)
+#define K8_PAGED_MULTIPLEX_INDEXED_NP(name, func, nn, nnn, np, nm, iscopy)\
+K8_PAGED_MULTIPLEX_INDEXED_PARTIAL_ALIAS(name, func, nn, nnn, np, nm, 0, (size_t)(STATE_SIZE(nm)/STATE_SIZE(nn)), iscopy, NOPARALLEL)
+
+//Run a state##np kernel on every page, in parallel. Pages never depend on each other.
+//Pages are big, so each is a task of its own, on whichever backend is in use.
+#define K8_PAGED_PAGEWISE_ALIAS(name, func, np, nm, alias)\
+static inline void name##_pages(void* k8arg, size_t lo, size_t hi){\
+	paged##np##_##nm* a = k8arg;\
+	for(size_t pg = lo; pg < hi; pg++)\
+		func(paged##np##_##nm##_page(a, pg));\
+}\
+static inline void name(paged##np##_##nm *a){\
+	K8_PROFILE_BEGIN(name)\
+	k8_parallel_tasks(name##_pages, a, K8_PAGES(np, nm), K8_ALIAS_THREADED(alias));\
+	K8_PROFILE_END(K8_PAGES(np, nm), STATE_SIZE(nm), STATE_SIZE(nm))\
+}
+#define K8_PAGED_PAGEWISE(name, func, np, nm) K8_PAGED_PAGEWISE_ALIAS(name, func, np, nm, PARALLEL)
+#define K8_PAGED_PAGEWISE_NP(name, func, np, nm) K8_PAGED_PAGEWISE_ALIAS(name, func, np, nm, NOPARALLEL)
+
+/*
+Exhaustive sweeps, for proving a kernel complete (and correct) over its entire domain.
+K8_SWEEP(name, func, n, iscopy) generates
+
+	void name(uint64_t first, uint64_t count, uint64_t stride, k8_sweep_check check, void* accs, size_t accsize)
+
+which runs func on the inputs first, first+stride, first+2*stride... (count of them),
+K8_SWEEP_BLOCK inputs at a time, on every core.
+The inputs are to_state##n(input). Each block of outputs is handed to check, which is told the
+input of the first element of the block and the stride.
+accs holds k8_max_threads() accumulators, accsize bytes apart. check receives the one belonging
+to the calling thread, so it never needs to lock. Merging them is up to the caller.
+Only up to state3 can be swept, a state4 has 2^64 inputs.
+*/
+#ifndef K8_SWEEP_BLOCK
+#define K8_SWEEP_BLOCK 4096
+#endif
+typedef void (*k8_sweep_check)(uint64_t first, uint64_t stride, const void* out, size_t len, void* acc);
+
+#define K8_SWEEP_CALL(iscopy, func) K8_SWEEP_CALL_##iscopy(func)
+#define K8_SWEEP_CALL_1(func) buf[k] = func(buf[k]);
+#define K8_SWEEP_CALL_0(func) func(buf + k);
+
+#define K8_SWEEP(name, func, n, iscopy)\
+static inline void name(uint64_t first, uint64_t count, uint64_t stride, k8_sweep_check check, void* accs, size_t accsize){\
+	const int64_t nblocks = (count + K8_SWEEP_BLOCK - 1) / K8_SWEEP_BLOCK;\
+	K8_STATIC_ASSERT(n <= 3);\
+	PRAGMA_PARALLEL\
+	for(int64_t blk = 0; blk < nblocks; blk++){\
+		state##n buf[K8_SWEEP_BLOCK];\
+		const uint64_t done = (uint64_t)blk * K8_SWEEP_BLOCK;\
+		const uint64_t base = first + done * stride;\
+		const size_t len = (count - done < K8_SWEEP_BLOCK) ? (size_t)(count - done) : K8_SWEEP_BLOCK;\
+		for(size_t k = 0; k < len; k++)\
+			buf[k] = to_state##n(base + k * stride);\
+		for(size_t k = 0; k < len; k++)\
+			K8_SWEEP_CALL(iscopy, func)\
+		check(base, stride, buf, len, (BYTE*)accs + (size_t)k8_thread_num() * accsize);\
+	}\
+}
+
 #define K8_WRAP_OP2(name, n, nn)\
 static inline state##nn kb_##name##_s##n(state##nn c) {k_##name##_s##n(&c); return c;}
 #define K8_WRAP_OP1(name, n, nn)\